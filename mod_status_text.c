@@ -35,15 +35,29 @@
 #include "http_log.h"
 #include "mod_status.h"
 #include "ap_listen.h"
+#include "unixd.h"
 #if APR_HAVE_UNISTD_H
 #include <unistd.h>
 #endif
+#include <errno.h>
+#include <signal.h>
 #include "apr_version.h"
 #include "apu_version.h"
 #define APR_WANT_STRFUNC
 #include "apr_want.h"
 #include "apr_strings.h"
+#include "apr_lib.h"
+#include "apr_atomic.h"
+#include "apr_mmap.h"
+#include "apr_thread_proc.h"
+#include "apr_signal.h"
+#if APR_HAS_THREADS
+#include "apr_thread_mutex.h"
+#endif
+#include <math.h>
 #include "mod_status_text_config.h"
+#include "status_text_binary.h"
+#include "status_text_shm.h"
 #include "scoreboard.h"
 
 #ifdef NEXT
@@ -59,71 +73,413 @@
 #endif /* NEXT */
 
 #define STATUS_MAGIC_TYPE "application/x-httpd-status-text"
+/* response times are measured in microseconds, and displayed in ms */
+#define STATUS_TEXT_MSEC(t) ((double)(t) / 1000.0)
 #define KBYTE 1024
 #define MOD_VERSION "1.2.2"
 
 module AP_MODULE_DECLARE_DATA status_text_module;
 
-/* status text scoreboard */
+/* response time histogram geometry (HDR like log-linear buckets):
+ * values below STATUS_TEXT_HIST_SUB_COUNT have their own bucket, above
+ * that each power of two range is split in STATUS_TEXT_HIST_SUB_COUNT
+ * linear sub buckets, so the bucket width is at most 1/8 of the value.
+ * values of 2^STATUS_TEXT_HIST_MAX_BITS and more go in the last bucket
+ * (response times are in microseconds, so above about 71 minutes).
+ */
+#define STATUS_TEXT_HIST_SUB_BITS  3
+#define STATUS_TEXT_HIST_SUB_COUNT (1 << STATUS_TEXT_HIST_SUB_BITS)
+#define STATUS_TEXT_HIST_MAX_BITS  32
+#define STATUS_TEXT_HIST_BUCKETS   ((STATUS_TEXT_HIST_MAX_BITS - STATUS_TEXT_HIST_SUB_BITS + 1) \
+                                    * STATUS_TEXT_HIST_SUB_COUNT)
+
+/* status codes with their own counters, other codes are counted per
+ * class. the counter index of a status code is given by
+ * status_text_code_index: 0 for invalid codes, 1 to 5 for the codes of
+ * each class not in this table, then STATUS_TEXT_FIRST_CODE + position
+ * in this table.
+ */
+static const int status_text_codes[] = {
+    100, 101, 102, 103,
+    200, 201, 202, 203, 204, 205, 206, 207, 208, 226,
+    300, 301, 302, 303, 304, 305, 307, 308,
+    400, 401, 402, 403, 404, 405, 406, 407, 408, 409, 410, 411, 412, 413,
+    414, 415, 416, 417, 418, 421, 422, 423, 424, 425, 426, 428, 429, 431,
+    451, 499,
+    500, 501, 502, 503, 504, 505, 506, 507, 508, 510, 511
+};
+#define STATUS_TEXT_FIRST_CODE 6
+#define STATUS_TEXT_NB_CODES   (STATUS_TEXT_FIRST_CODE + \
+                                sizeof(status_text_codes) / sizeof(status_text_codes[0]))
+
+/* status code to counter index, built at post config */
+static unsigned char status_text_code_index[600];
+
+/* historical status code keys, still computed from the per code counters */
+static const char *status_text_legacy_codes[] = {
+    "xxx", "10x", "200", "20x", "301", "302", "304", "30x", "404", "40x", "50x", NULL
+};
+
+/* number of requests and bytes of a status code */
 typedef struct {
-    /* number of request per status code */
-    apr_uint64_t nb_reqs_xxx;
-    apr_uint64_t nb_reqs_10x;
-    apr_uint64_t nb_reqs_200;
-    apr_uint64_t nb_reqs_20x;
-    apr_uint64_t nb_reqs_301;
-    apr_uint64_t nb_reqs_302;
-    apr_uint64_t nb_reqs_304;
-    apr_uint64_t nb_reqs_30x;
-    apr_uint64_t nb_reqs_404;
-    apr_uint64_t nb_reqs_40x;
-    apr_uint64_t nb_reqs_50x;
-
-    /* number of bytes per status code */
-    apr_uint64_t nb_bytes_xxx;
-    apr_uint64_t nb_bytes_10x;
-    apr_uint64_t nb_bytes_200;
-    apr_uint64_t nb_bytes_20x;
-    apr_uint64_t nb_bytes_301;
-    apr_uint64_t nb_bytes_302;
-    apr_uint64_t nb_bytes_304;
-    apr_uint64_t nb_bytes_30x;
-    apr_uint64_t nb_bytes_404;
-    apr_uint64_t nb_bytes_40x;
-    apr_uint64_t nb_bytes_50x;
+    apr_uint64_t reqs;
+    apr_uint64_t bytes;
+} status_text_code_count_t;
 
-    /* number of request per response times range */
-    apr_time_t nb_reqs_50ms;  /* 0ms to 50ms range */
-    apr_time_t nb_reqs_100ms; /* 51ms to 100ms range */
-    apr_time_t nb_reqs_300ms; /* 101ms to 300ms range */
-    apr_time_t nb_reqs_500ms; /* 301ms to 500ms range */
-    apr_time_t nb_reqs_1s;    /* 501ms to 1s range */
-    apr_time_t nb_reqs_1_5s;  /* 1s to 1.5s range */
-    apr_time_t nb_reqs_2s;    /* 1.5s to 2s range */
-    apr_time_t nb_reqs_5s;    /* 2s to 5s range */
-    apr_time_t nb_reqs_10s;   /* 5s to 10s range */
-    apr_time_t nb_reqs_15s;   /* 10s to 15s range */
-    apr_time_t nb_reqs_20s;   /* 15s to 20s range */
-    apr_time_t nb_reqs_30s;   /* 20s to 30s range */
-    apr_time_t nb_reqs_xs;    /* more than 30s range */
+/* maximum number of response time ranges, the last one counts the
+ * response times above the last StatusTextLatencyBuckets boundary */
+#define STATUS_TEXT_MAX_LATENCY_BUCKETS 32
+
+/* default response time ranges upper bounds (in microseconds) */
+static const apr_time_t status_text_default_latency_bounds[] = {
+    50000, 100000, 300000, 500000, 1000000, 1500000, 2000000, 5000000,
+    10000000, 15000000, 20000000, 30000000
+};
+
+/* server configuration */
+typedef struct {
+    int nb_latency_bounds; /* 0 if StatusTextLatencyBuckets not set */
+    apr_time_t latency_bounds[STATUS_TEXT_MAX_LATENCY_BUCKETS - 1];
+    int series_seconds; /* StatusTextSeriesSeconds, -1 if not set */
+    apr_interval_time_t cache_ttl; /* StatusTextCacheTTL, -1 if not set */
+    const char *export_file; /* StatusTextExportFile, NULL if not set */
+    const char *push;        /* StatusTextPush, NULL if not set */
+    apr_interval_time_t push_interval; /* StatusTextPushInterval, -1 if not set */
+    int push_packet;         /* StatusTextPushPacketSize, 0 if not set */
+    apr_interval_time_t agg_interval; /* StatusTextAggregateInterval, -1 if not set */
+    const char *checkpoint_file; /* StatusTextCheckpointFile, NULL if not set */
+    apr_interval_time_t checkpoint_interval; /* StatusTextCheckpointInterval, -1 if not set */
+    int process_slots;       /* StatusTextProcessSlots, 0 if not set */
+    int granularity;         /* StatusTextGranularity, 0 if not set */
+} status_text_server_conf;
+
+/* response time ranges in use, set at post config from the main server:
+ * the sorted upper bounds padded with APR_INT64_MAX for the branch free
+ * lookup (see status_text_latency_index), and their key names. */
+static apr_time_t status_text_latency_bounds[STATUS_TEXT_MAX_LATENCY_BUCKETS];
+static const char *status_text_latency_keys[STATUS_TEXT_MAX_LATENCY_BUCKETS];
+static int status_text_nb_latency_buckets;
+
+/* exponentially weighted moving averages windows (in minutes) */
+#define STATUS_TEXT_EWMA_WINDOWS 3
+static const int status_text_ewma_minutes[STATUS_TEXT_EWMA_WINDOWS] = { 1, 5, 15 };
+
+/* time decayed sums of an exponentially weighted moving average window:
+ * each value is decayed by exp(-elapsed/window) before adding the new
+ * request, so reqs/window is the requests rate, bytes/window the bytes
+ * rate and time/reqs the average response time of the window. the sums of
+ * several slots decayed to the same time can be added.
+ */
+typedef struct {
+    double reqs;  /* decayed number of requests */
+    double bytes; /* decayed number of bytes */
+    double time;  /* decayed sum of response times (in microseconds) */
+} status_text_ewma_t;
+
+/* per second time series: requests, bytes, 4xx/5xx and a response time
+ * sketch (requests per power of two of the response time in microseconds)
+ * of each second, in a ring of StatusTextSeriesSeconds seconds.
+ */
+#define STATUS_TEXT_SERIES_DEFAULT_SECONDS 300
+#define STATUS_TEXT_SERIES_MAX_SECONDS     3600
+#define STATUS_TEXT_SERIES_SKETCH          32
+#define STATUS_TEXT_SERIES_RESET           0xFFFFFFFF /* ring bucket being reset */
+
+typedef struct {
+    apr_uint32_t second; /* monotonic second of the bucket, 0 if unused */
+    apr_uint32_t sketch[STATUS_TEXT_SERIES_SKETCH];
+    apr_uint64_t reqs;
+    apr_uint64_t bytes;
+    apr_uint64_t reqs_4xx;
+    apr_uint64_t reqs_5xx;
+} status_text_series_t;
+
+static int status_text_series_seconds = STATUS_TEXT_SERIES_DEFAULT_SECONDS;
+
+/* sliding windows of the response time percentiles: each slot keeps two
+ * epochs of the window length per window, the current one and the previous
+ * one, the previous one is weighted by the part of it still in the window */
+#define STATUS_TEXT_WINDOWS 3
+static const int status_text_window_seconds[STATUS_TEXT_WINDOWS] = { 10, 60, 300 };
+static const char *status_text_window_names[STATUS_TEXT_WINDOWS] = { "10s", "1m", "5m" };
+#define STATUS_TEXT_DEFAULT_WINDOW 1 /* window of the keys without suffix */
+
+/* percentiles (in per mille) of the window keys */
+#define STATUS_TEXT_NB_PERCENTILS 4
+static const int status_text_percentil_permille[STATUS_TEXT_NB_PERCENTILS] = { 500, 900, 990, 999 };
+static const char *status_text_percentil_keys[STATUS_TEXT_NB_PERCENTILS] = {
+    "Apache_50Percentil_ResponseTime", "Apache_90Percentil_ResponseTime",
+    "Apache_99Percentil_ResponseTime", "Apache_99_9Percentil_ResponseTime"
+};
+
+/* cache line size used to lay out the status text scoreboard */
+#ifndef STATUS_TEXT_CACHE_LINE
+#define STATUS_TEXT_CACHE_LINE 64
+#endif
+
+/* 32 bits number of requests and bytes of a status code, in a slot */
+typedef struct {
+    apr_uint32_t reqs;
+    apr_uint32_t bytes;
+} status_text_code_count32_t;
+
+/* the request counters of a slot, of a block and of a snapshot (the codes,
+ * the response time ranges then the histogram) are also one vector, so
+ * that they are added up in a single loop the compiler can vectorize (see
+ * status_text_add_counters). the vector is padded to a multiple of 8
+ * counters, the loop then needs no scalar epilogue */
+#define STATUS_TEXT_NB_COUNTERS APR_ALIGN(2 * STATUS_TEXT_NB_CODES + STATUS_TEXT_MAX_LATENCY_BUCKETS \
+                                          + STATUS_TEXT_HIST_BUCKETS, 8)
+
+/* status text scoreboard: one slot per worker thread, written on each
+ * request by its thread only. slots are padded to a multiple of the cache
+ * line and cache line aligned (see STATUS_TEXT_SLOT), so two threads
+ * never write in the same cache line.
+ * the slot and its cold fields are updated under a seqlock: seq is odd
+ * while its thread updates them, the handler copies a slot again when seq
+ * was odd or changed during the copy (see status_text_read_slot).
+ * the counters of a slot are 32 bits, folded in the 64 bits totals of its
+ * block before they overflow (see status_text_count32).
+ */
+typedef struct {
+    volatile apr_uint32_t seq;
 
     /* response time statistiques... */
-    apr_time_t last; /* last response time */
-    apr_time_t avg; /* average response time */
-    apr_time_t percentil; /* 90% percentil response time */
+    apr_time_t last; /* last response time (in microseconds) */
+
+    /* time decayed moving averages (see status_text_ewma_update) */
+    apr_time_t ewma_time; /* monotonic time of the last update */
+    status_text_ewma_t ewma[STATUS_TEXT_EWMA_WINDOWS];
+
+    union {
+      struct {
+        /* number of requests and bytes per status code (see status_text_code_index) */
+        status_text_code_count32_t codes[STATUS_TEXT_NB_CODES];
+
+        /* number of request per response times range (see StatusTextLatencyBuckets) */
+        apr_uint32_t nb_reqs_latency[STATUS_TEXT_MAX_LATENCY_BUCKETS];
+
+        /* log-linear response time histogram (see status_text_hist_index) */
+        apr_uint32_t hist[STATUS_TEXT_HIST_BUCKETS];
+      };
+      apr_uint32_t counters[STATUS_TEXT_NB_COUNTERS];
+    };
+    apr_uint64_t time_sum; /* sum of the response times (in microseconds) */
+
+    /* current second of the per second time series, added to the shared
+     * ring at the first request of a new second */
+    status_text_series_t series;
 
-    apr_time_t first_trend;  /* first trend date */
-    apr_time_t trend[10]; /* circular array used to calculate percentil */
-    int trend_curpos; /* circular array current position */
+    /* sliding windows histograms, the histogram of the epoch e (monotonic
+     * seconds / window length) is window_hist[w][e&1]. most of the slot,
+     * last so that the aggregations without percentils do not copy them
+     * (see STATUS_TEXT_SLOT_HOT_SIZE) */
+    apr_uint32_t window_epoch[STATUS_TEXT_WINDOWS]; /* last epoch written */
+    apr_uint32_t window_hist[STATUS_TEXT_WINDOWS][2][STATUS_TEXT_HIST_BUCKETS];
 } status_text_scoreboard_t; 
 
+/* part of a slot before the windows histograms */
+#define STATUS_TEXT_SLOT_HOT_SIZE APR_OFFSETOF(status_text_scoreboard_t, window_epoch)
+
+/* rarely written per slot fields, kept out of the per request cache lines */
+typedef struct {
+    apr_time_t max; /* maximum response time (in microseconds) */
+} status_text_scoreboard_cold_t;
+
+/* the slots are grouped in blocks of status_text_threads slots, one block
+ * per child process (see status_text_claim_block). a block has the 64 bits
+ * totals the 32 bits counters of its slots are folded in, between
+ * fold_start and fold_end increments so that a reader can see a fold
+ * (see status_text_count32). the last block, the overflow one, has no
+ * slot: the requests of a child without block (or of a thread beyond the
+ * block) are added to its totals with atomic operations.
+ */
+typedef struct {
+    volatile apr_uint32_t owner;      /* pid of the child of the block, 0 if never claimed */
+    volatile apr_uint32_t used;       /* the block has statistics, else it is skipped */
+    volatile apr_uint32_t fold_start; /* folds started */
+    volatile apr_uint32_t fold_end;   /* folds done */
+    apr_uint64_t time_sum;            /* not in a slot: overflow, checkpoint, migration */
+    apr_time_t max;                   /* idem */
+    union {
+      struct {
+        status_text_code_count_t codes[STATUS_TEXT_NB_CODES];
+        apr_uint64_t nb_reqs_latency[STATUS_TEXT_MAX_LATENCY_BUCKETS];
+        apr_uint64_t hist[STATUS_TEXT_HIST_BUCKETS];
+      };
+      apr_uint64_t counters[STATUS_TEXT_NB_COUNTERS];
+    };
+} status_text_block_t;
+
+/* 32 bits counters are folded before they reach this value */
+#define STATUS_TEXT_FOLD_LIMIT 0x80000000U
+
 const char *status_text_scorebored_name = NULL;
 apr_shm_t *status_text_scoreboard_shm = NULL;
+status_text_shm_header_t *status_text_shm_header = NULL; /* header of the segment */
 status_text_scoreboard_t *status_text_scoreboard = NULL;
+status_text_scoreboard_cold_t *status_text_scoreboard_cold = NULL;
+status_text_block_t *status_text_blocks = NULL; /* status_text_nb_blocks + the overflow one */
+static int status_text_nb_blocks;  /* blocks of slots */
+static int status_text_threads;    /* slots per block: ThreadsPerChild, 1 without threads */
+static int status_text_process_slots = 0; /* StatusTextProcessSlots, 0 for MaxRequestWorkers */
+static int status_text_my_block = -1; /* block of the child, -1 if none */
+
+/* StatusTextGranularity: a slot per thread, or a slot per child shared by
+ * its threads (the blocks have one slot, the threads take its seqlock in
+ * turn, see status_text_slot_lock) */
+#define STATUS_TEXT_GRANULARITY_THREAD  1
+#define STATUS_TEXT_GRANULARITY_PROCESS 2
+static int status_text_granularity = STATUS_TEXT_GRANULARITY_THREAD;
+status_text_series_t *status_text_series = NULL; /* per second ring */
+
+/* StatusTextExportFile: the segment is then a shared mapping of this
+ * file, renamed to its name once initialized so that the local agents
+ * (see status_text_shm.h) never map a partial file */
+static const char *status_text_export_file = NULL;
+static apr_mmap_t *status_text_export_mmap = NULL;
+static pid_t status_text_export_pid;
+
+/* pool of the segment, and the layout it was created with: a restart
+ * keeps the segment when the layout did not change, else its statistics
+ * are carried over to the new one (see status_text_migrate) */
+static apr_pool_t *status_text_segment_pool = NULL;
+static struct {
+    int server_limit, thread_limit, nb_blocks, threads, series_seconds;
+    apr_size_t size; /* requested size */
+    const char *export_file;
+} status_text_layout;
+
+/* settings of the segment and of the helper process, read by the
+ * post_config hook and applied when pre_mpm creates the scoreboard: a
+ * graceful restart does not run pre_mpm, it keeps the segment and the
+ * helper with the settings they were created with (and the response time
+ * ranges its counters were counted with) */
+static struct {
+    apr_pool_t *pool; /* configuration pool, for the names of the ranges */
+    int nb_latency_bounds;
+    apr_time_t latency_bounds[STATUS_TEXT_MAX_LATENCY_BUCKETS - 1];
+    int series_seconds, process_slots, granularity;
+    apr_interval_time_t agg_interval;
+    const char *export_file;
+    const char *push;
+    apr_interval_time_t push_interval;
+    int push_packet;
+    const char *checkpoint_file;
+    apr_interval_time_t checkpoint_interval;
+} status_text_settings;
+
+/* snapshots published for the delta scrapes (since=): a ring of
+ * STATUS_TEXT_DELTA_TOKENS entries after the series ring, each with a value
+ * per key (see status_text_delta_value) then the worker lines printed, by
+ * index: pairs of the line index (child * thread_limit + thread) and hash */
+#define STATUS_TEXT_DELTA_TOKENS     8
+#define STATUS_TEXT_DELTA_EXTRA_KEYS 64 /* room for the keys added by graceful restarts */
+
+typedef struct {
+    volatile apr_uint32_t seq;     /* sequence number of the snapshot, 0 while written */
+    volatile apr_uint32_t writing; /* 1 while an handler writes the entry */
+    apr_time_t restart_time;       /* restart time of the snapshot */
+    int has_workers;               /* the worker lines values are set */
+    apr_uint32_t nb_lines;         /* worker lines values */
+} status_text_delta_t;
+
+volatile apr_uint32_t *status_text_delta_seq = NULL; /* last sequence number */
+status_text_delta_t *status_text_delta = NULL;
+static int status_text_delta_keys;        /* number of key values of an entry */
+static apr_uint32_t status_text_delta_lines; /* room for the worker lines of an entry */
+static apr_size_t status_text_delta_size; /* size of an entry */
+
+#define STATUS_TEXT_DELTA(i) ((status_text_delta_t *) \
+        ((char *)status_text_delta + (apr_size_t)(i) * status_text_delta_size))
+#define STATUS_TEXT_DELTA_VALUES(d) ((apr_uint64_t *) \
+        ((char *)(d) + APR_ALIGN_DEFAULT(sizeof(status_text_delta_t))))
 
 static int server_limit, thread_limit;
 static int forked, threaded;
 static apr_size_t status_text_scoreboard_size;
+static apr_size_t status_text_slot_size; /* cache line padded slot size */
+static apr_size_t status_text_block_size; /* cache line padded block size */
+
+/* memory barriers of the slot seqlock: the writer orders its stores after
+ * the odd seq and before the even seq, the reader orders its loads between
+ * the two seq reads */
+#if defined(__ATOMIC_ACQUIRE)
+#define STATUS_TEXT_WRITE_BARRIER() __atomic_thread_fence(__ATOMIC_RELEASE)
+#define STATUS_TEXT_READ_BARRIER()  __atomic_thread_fence(__ATOMIC_ACQUIRE)
+#elif defined(__GNUC__)
+#define STATUS_TEXT_WRITE_BARRIER() __sync_synchronize()
+#define STATUS_TEXT_READ_BARRIER()  __sync_synchronize()
+#else
+static volatile apr_uint32_t status_text_barrier_dummy;
+#define STATUS_TEXT_WRITE_BARRIER() apr_atomic_cas32(&status_text_barrier_dummy,0,0)
+#define STATUS_TEXT_READ_BARRIER()  apr_atomic_cas32(&status_text_barrier_dummy,0,0)
+#endif
+
+/* maximum number of copies of a slot while its thread updates it */
+#define STATUS_TEXT_READ_TRIES 100
+
+/* get a status text scoreboard slot by its scoreboard position */
+#define STATUS_TEXT_SLOT(pos) ((status_text_scoreboard_t *) \
+        ((char *)status_text_scoreboard + (apr_size_t)(pos) * status_text_slot_size))
+
+/* get a block of slots, status_text_nb_blocks for the overflow one */
+#define STATUS_TEXT_BLOCK(b) ((status_text_block_t *) \
+        ((char *)status_text_blocks + (apr_size_t)(b) * status_text_block_size))
+
+/* occupancy of the apache scoreboard, after the cold fields: the largest
+ * ThreadsPerChild of the generations, then a bit per process slot and a
+ * bit per worker that served a request (see status_text_mark_worker). the
+ * walks of the apache scoreboard only read the workers of the live
+ * children up to the largest ThreadsPerChild, and the marked workers of
+ * the other process slots (see status_text_walk_limit) */
+static volatile apr_uint32_t *status_text_occupancy = NULL;
+#define STATUS_TEXT_OCC_PROCESSES (status_text_occupancy + 1)
+#define STATUS_TEXT_OCC_WORKERS   (STATUS_TEXT_OCC_PROCESSES + (server_limit + 31) / 32)
+#define STATUS_TEXT_OCC_SIZE      APR_ALIGN_DEFAULT(sizeof(apr_uint32_t) * \
+        (1 + (server_limit + 31) / 32 + ((apr_size_t)server_limit * thread_limit + 31) / 32))
+#define STATUS_TEXT_OCC_BIT(words, n) ((words)[(n) >> 5] & (1U << ((n) & 31)))
+
+/* set a bit of the occupancy */
+static void status_text_occ_set(volatile apr_uint32_t *words, apr_size_t n)
+{
+    volatile apr_uint32_t *w=&words[n>>5];
+    apr_uint32_t mask=1U<<(n&31), cur;
+
+    while (!((cur=*w)&mask) && apr_atomic_cas32(w,cur|mask,cur)!=cur);
+}
+
+/* mark the worker of a request and its process slot, once */
+static APR_INLINE void status_text_mark_worker(int child_num, int thread_num)
+{
+    apr_size_t n=(apr_size_t)child_num*thread_limit+thread_num;
+
+    if (status_text_occupancy==NULL || child_num<0 || child_num>=server_limit ||
+        thread_num<0 || thread_num>=thread_limit || STATUS_TEXT_OCC_BIT(STATUS_TEXT_OCC_WORKERS,n))
+      return;
+    status_text_occ_set(STATUS_TEXT_OCC_WORKERS,n);
+    status_text_occ_set(STATUS_TEXT_OCC_PROCESSES,child_num);
+}
+
+/* the worker j of the process slot i served a request */
+static APR_INLINE int status_text_worker_marked(int i, int j)
+{
+    return STATUS_TEXT_OCC_BIT(STATUS_TEXT_OCC_WORKERS,(apr_size_t)i*thread_limit+j) != 0;
+}
+
+/* number of workers of the process slot i to read: the workers of a live
+ * child up to the largest ThreadsPerChild, else with *marked_only set the
+ * marked ones (their counters stay in the apache scoreboard), 0 when no
+ * worker of the slot was ever marked */
+static int status_text_walk_limit(int i, const process_score *ps_record, int *marked_only)
+{
+    *marked_only=0;
+    if (status_text_occupancy==NULL) return thread_limit;
+    if (ps_record->pid) return (int)status_text_occupancy[0];
+    if (!STATUS_TEXT_OCC_BIT(STATUS_TEXT_OCC_PROCESSES,i)) return 0;
+    *marked_only=1;
+    return thread_limit;
+}
 
 #ifdef HAVE_TIMES
 /* ugh... need to know if we're running with a pthread implementation
@@ -140,999 +496,3013 @@ typedef struct  {
 } my_sb_handle_t;
 
 
-static char status_text_flags[SERVER_NUM_STATUS];
-
-static int runtime_statistique(request_rec *r)
+/* index of the most significant bit set (v must not be 0) */
+static APR_INLINE int status_text_msb(apr_uint64_t v)
 {
-    /* now time */
-    apr_time_t now=apr_time_now();
-
-    /* get scoreboard handle to get current thread and child number */
-    my_sb_handle_t *sb=r->connection->sbh; 
-    /* scoreboard current position */
-    int sb_pos=sb->child_num * thread_limit + sb->thread_num;
-
-    /* get status text scoreboard share memory */
-    status_text_scoreboard_t *st_sb=&status_text_scoreboard[sb_pos];
-
-    /* get the current worker score */
-    /*worker_score *ws = &ap_scoreboard_image->servers[sb->child_num][sb->thread_num];*/
-
-    /* request bytes sent */
-    apr_uint64_t bytes=r->bytes_sent;
-
-    /* request time duration */
-    apr_time_t req_response_time=(now-r->request_time)/1000;
+#if defined(__GNUC__)
+    return 63 - __builtin_clzll(v);
+#else
+    int msb=0;
+    while (v>>=1) msb++;
+    return msb;
+#endif
+}
 
-    if (req_response_time>0) 
-    {
-      /* update last response time */
-      st_sb->last=req_response_time;
+/* get the histogram bucket of a response time, O(1) without any loop */
+static APR_INLINE int status_text_hist_index(apr_time_t value)
+{
+    apr_uint64_t v=(value>0)?(apr_uint64_t)value:0;
+    int shift;
 
-      /* update average response time */
-      if (st_sb->avg!=0) st_sb->avg=(st_sb->avg+req_response_time)/2;
-      else st_sb->avg=req_response_time;
+    if (v<STATUS_TEXT_HIST_SUB_COUNT) return (int)v;
+    if (v>>STATUS_TEXT_HIST_MAX_BITS) return STATUS_TEXT_HIST_BUCKETS-1;
 
-      /* if trend is from more than 10s  ==> reinitialisze */
-      if ((now-st_sb->first_trend)>(10*1000))
-      {
-         /* reinitialise with avg response time */
-         st_sb->percentil=st_sb->avg;
+    shift=status_text_msb(v)-STATUS_TEXT_HIST_SUB_BITS;
+    return (shift<<STATUS_TEXT_HIST_SUB_BITS)+(int)(v>>shift);
+}
 
-         /* initialize first trend time */
-         st_sb->first_trend=now;
+/* get the highest response time counted in an histogram bucket */
+static apr_time_t status_text_hist_upper(int idx)
+{
+    int shift;
+    apr_uint64_t mantissa;
 
-	 /* reinit position */
-	 st_sb->trend_curpos=0;
+    if (idx<2*STATUS_TEXT_HIST_SUB_COUNT) return idx;
 
-         /* restart to first position */
-	 st_sb->trend[st_sb->trend_curpos++]=req_response_time;
-      }
+    shift=(idx>>STATUS_TEXT_HIST_SUB_BITS)-1;
+    mantissa=(idx&(STATUS_TEXT_HIST_SUB_COUNT-1))+STATUS_TEXT_HIST_SUB_COUNT;
+    return (apr_time_t)(((mantissa+1)<<shift)-1);
+}
 
-      /* update 90% perscentil response time */
-      if (st_sb->trend_curpos<10)
-      {
-	 //int i;
-	 st_sb->trend[st_sb->trend_curpos++]=req_response_time;
-         //for(i=1;i<st_sb->trend_curpos;i++) st_sb->avg+=st_sb->trend[i];
-         //st_sb->avg/=st_sb->trend_curpos;
-      }
-      else
-      {
-	 /* sort the trend array (insertion sort algo) */
-	 int i;
-	 int j;
-	 for(i=1;i<10;i++)
-	 {
-	   apr_time_t x=st_sb->trend[i];
-	   j=i;
-	   while(j>0&&st_sb->trend[j-1]>x)
-	   {
-	     st_sb->trend[j]=st_sb->trend[j-1];
-	     j=j-1;
-	   }
-	   st_sb->trend[j]=x;
-	 }
-	 /* get 90% centil */
-	 st_sb->percentil=st_sb->trend[8];
-
-         /* initialize first trend time */
-         st_sb->first_trend=now;
-
-	 /* reinit position */
-	 st_sb->trend_curpos=0;
-      }
+/* add a response time to the sliding windows histograms of a slot, starting
+ * a new epoch when the window length is elapsed. the other epoch histogram
+ * is cleared unless it is the previous epoch, a time of an older epoch is
+ * counted in the current one */
+static APR_INLINE void status_text_window_update(status_text_scoreboard_t *st_sb, apr_time_t now,
+                                                 int idx)
+{
+    apr_uint32_t sec=(apr_uint32_t)apr_time_sec(now), epoch;
+    int w;
 
-      if (st_sb->percentil==0) 
+    for (w = 0; w < STATUS_TEXT_WINDOWS; ++w)
+    {
+      epoch=sec/status_text_window_seconds[w];
+      if (epoch<st_sb->window_epoch[w]) epoch=st_sb->window_epoch[w];
+      if (epoch!=st_sb->window_epoch[w])
       {
-         st_sb->percentil=st_sb->avg;
-         /* initialize first trend time */
-         st_sb->first_trend=now;
+        memset(st_sb->window_hist[w][epoch&1],0,sizeof(st_sb->window_hist[w][0]));
+        if (epoch!=st_sb->window_epoch[w]+1)
+          memset(st_sb->window_hist[w][(epoch&1)^1],0,sizeof(st_sb->window_hist[w][0]));
+        st_sb->window_epoch[w]=epoch;
       }
+      st_sb->window_hist[w][epoch&1][idx]++;
     }
+}
 
-    /* request response time distribution */
-    if (req_response_time<=50)
-      st_sb->nb_reqs_50ms++;  
-    else if (req_response_time<=100)
-      st_sb->nb_reqs_100ms++;  
-    else if (req_response_time<=300)
-      st_sb->nb_reqs_300ms++;  
-    else if (req_response_time<=500)
-      st_sb->nb_reqs_500ms++;  
-    else if (req_response_time<=1*1000)
-      st_sb->nb_reqs_1s++;  
-    else if (req_response_time<=1.5*1000)
-      st_sb->nb_reqs_1_5s++;  
-    else if (req_response_time<=2*1000)
-      st_sb->nb_reqs_2s++;  
-    else if (req_response_time<=5*1000)
-      st_sb->nb_reqs_5s++;  
-    else if (req_response_time<=10*1000)
-      st_sb->nb_reqs_10s++;  
-    else if (req_response_time<=15*1000)
-      st_sb->nb_reqs_15s++;  
-    else if (req_response_time<=20*1000)
-      st_sb->nb_reqs_20s++;  
-    else if (req_response_time<30*1000)
-      st_sb->nb_reqs_30s++;  
-    else
-      st_sb->nb_reqs_xs++;  
+/* add the sliding window w of a slot to an histogram: the current epoch
+ * and the previous one weighted by the part of it still in the window */
+static void status_text_window_merge(double *hist, const status_text_scoreboard_t *st_sb, int w,
+                                     apr_time_t now)
+{
+    apr_uint32_t len=status_text_window_seconds[w];
+    apr_uint32_t epoch=(apr_uint32_t)(apr_time_sec(now)/len);
+    apr_uint32_t last=st_sb->window_epoch[w];
+    const apr_uint32_t *cur=NULL, *prev=NULL;
+    double weight;
+    int i;
 
-    /* number of requests/bytes per type of response status code */
-    if (r->status>=500)
-    {
-      st_sb->nb_reqs_50x++;  
-      st_sb->nb_bytes_50x+=bytes;  
-    }
-    else if (r->status>=400)
-    {
-      if (r->status==404)
-      {
-	st_sb->nb_reqs_404++;  
-	st_sb->nb_bytes_404+=bytes;
-      }
-      else
-      {
-	st_sb->nb_reqs_40x++;  
-	st_sb->nb_bytes_40x+=bytes;
-      }
-    }
-    else if (r->status>=300)
-    {
-      if (r->status==301)
-      {
-	st_sb->nb_reqs_301++;  
-	st_sb->nb_bytes_301+=bytes;
-      }
-      else if (r->status==302)
-      {
-	st_sb->nb_reqs_302++;  
-	st_sb->nb_bytes_302+=bytes;
-      }
-      else if (r->status==304)
-      {
-	st_sb->nb_reqs_304++;  
-	st_sb->nb_bytes_304+=bytes;
-      }
-      else
-      {
-	st_sb->nb_reqs_30x++;  
-	st_sb->nb_bytes_30x+=bytes;
-      }
-    }
-    else if (r->status>=200)
+    /* elapsed part of the current epoch */
+    weight=1.0-(double)(now-(apr_time_t)epoch*len*APR_USEC_PER_SEC)/(double)(len*APR_USEC_PER_SEC);
+    if (weight<0.0) weight=0.0;
+
+    if (last==epoch)
     {
-      if (r->status==200)
-      {
-	st_sb->nb_reqs_200++;  
-	st_sb->nb_bytes_200+=bytes;
-      }
-      else
-      {
-	st_sb->nb_reqs_20x++;  
-	st_sb->nb_bytes_20x+=bytes;
-      }
+      cur=st_sb->window_hist[w][epoch&1];
+      prev=st_sb->window_hist[w][(epoch&1)^1];
     }
-    else if (r->status>=100)
+    else if (last+1==epoch) prev=st_sb->window_hist[w][last&1];
+    else return;
+
+    for (i = 0; i < STATUS_TEXT_HIST_BUCKETS; ++i)
     {
-      st_sb->nb_reqs_10x++;  
-      st_sb->nb_bytes_10x+=bytes;
+      if (cur) hist[i]+=cur[i];
+      hist[i]+=weight*prev[i];
     }
-    else if (r->status<100)
+}
+
+/* get a percentile (in per mille) from a sliding window histogram, capped to
+ * the maximum value really seen */
+static apr_time_t status_text_window_percentile(const double *hist, int permille, apr_time_t max)
+{
+    double nb=0.0, rank, cumul=0.0;
+    apr_time_t value;
+    int i;
+
+    for(i=0;i<STATUS_TEXT_HIST_BUCKETS;i++) nb+=hist[i];
+    if (nb<0.5) return 0;
+
+    rank=nb*permille/1000.0;
+    for(i=0;i<STATUS_TEXT_HIST_BUCKETS;i++)
     {
-      st_sb->nb_reqs_xxx++;  
-      st_sb->nb_bytes_xxx+=bytes;
+      cumul+=hist[i];
+      if (cumul>=rank && hist[i]>0.0) break;
     }
-       
-    return OK;
+    if (i==STATUS_TEXT_HIST_BUCKETS) return max;
+
+    value=status_text_hist_upper(i);
+    return (value>max)?max:value;
 }
 
-/* Main handler for x-httpd-status-text requests */
-static int status_text_handler(request_rec *r)
+/* get the response time range of a response time: the number of range
+ * upper bounds below it, with a branch free binary search on the
+ * STATUS_TEXT_MAX_LATENCY_BUCKETS bounds (32, the last one is always
+ * APR_INT64_MAX) */
+static APR_INLINE int status_text_latency_index(apr_time_t value)
 {
-    apr_time_t nowtime;
-    apr_interval_time_t up_time;
-    int max_daemons;
-    int j, i, res;
-    int lr_count=0;
-    ap_listen_rec *lr=NULL;
-    int ready;
-    int busy;
-    apr_uint64_t count;
-    apr_uint64_t lres, my_lres, conn_lres;
-    apr_uint64_t bytes, my_bytes, conn_bytes;
-    apr_uint64_t bcount, kbcount;
-    long req_time;
-#ifdef HAVE_TIMES
-    float tick;
-    int times_per_thread = getpid() != child_pid;
-#endif
-    worker_score ws_record_st;
-    worker_score *ws_record=&ws_record_st;
-    process_score *ps_record;
-    char *stat_buffer;
-    pid_t *pid_buffer, worker_pid;
-    clock_t tu, ts, tcu, tcs;
-    ap_generation_t worker_generation;
-    apr_time_t *percentil_array;
-    unsigned long nb_avg=0;
-    unsigned long nb_percentil=0;
-    unsigned long percentilpos=0;
+    const apr_time_t *bounds=status_text_latency_bounds;
+    int idx=0;
 
-    /* get status text scoreboard share memory */
-    status_text_scoreboard_t *st_sb=status_text_scoreboard;
-    status_text_scoreboard_t st_sb_total;
-    status_text_scoreboard_t *st_sb_cur;
+    idx+=(bounds[idx+15]<value)<<4;
+    idx+=(bounds[idx+7]<value)<<3;
+    idx+=(bounds[idx+3]<value)<<2;
+    idx+=(bounds[idx+1]<value)<<1;
+    idx+=(bounds[idx]<value);
+    return idx;
+}
 
-    if (strcmp(r->handler, STATUS_MAGIC_TYPE) && strcmp(r->handler, "server-status-text")) 
-        return DECLINED;
+/* monotonic time in microseconds, wall clock time if the system has no
+ * monotonic clock */
+static APR_INLINE apr_time_t status_text_monotonic_now(void)
+{
+#if defined(CLOCK_MONOTONIC)
+    struct timespec ts;
 
-#ifdef HAVE_TIMES
-#ifdef _SC_CLK_TCK
-    tick = sysconf(_SC_CLK_TCK);
-#else
-    tick = HZ;
-#endif
+    if (clock_gettime(CLOCK_MONOTONIC, &ts)==0)
+      return (apr_time_t)ts.tv_sec*APR_USEC_PER_SEC + ts.tv_nsec/1000;
 #endif
+    return apr_time_now();
+}
 
-    pid_buffer = apr_palloc(r->pool, server_limit * sizeof(pid_t));
-    stat_buffer = apr_palloc(r->pool, server_limit * thread_limit * sizeof(char));
-    percentil_array = apr_palloc(r->pool, server_limit * thread_limit * sizeof(apr_time_t));
+/* decay the moving averages of a slot to the monotonic time now (not
+ * before their time), and add a request to them */
+static void status_text_ewma_update(status_text_scoreboard_t *st_sb, apr_time_t now,
+                                    apr_uint64_t bytes, apr_time_t response_time)
+{
+    double elapsed=0;
+    int w;
 
-    ready = 0;
-    busy = 0;
-    count = 0;
-    bcount = 0;
-    kbcount = 0;
-    memset(&st_sb_total,0,sizeof(status_text_scoreboard_t));
-    memset(percentil_array,0,server_limit * thread_limit * sizeof(apr_time_t));
+    if (st_sb->ewma_time!=0 && now>st_sb->ewma_time)
+      elapsed=(double)(now-st_sb->ewma_time)/APR_USEC_PER_SEC;
 
-#if AP_MODULE_MAGIC_AT_LEAST(20090401,1)
-    ap_generation_t ap_my_generation;
-    ap_mpm_query(AP_MPMQ_GENERATION, &ap_my_generation);
-#endif
+    for (w = 0; w < STATUS_TEXT_EWMA_WINDOWS; ++w)
+    {
+      status_text_ewma_t *e=&st_sb->ewma[w];
+      if (elapsed>0)
+      {
+        double decay=exp(-elapsed/(60.0*status_text_ewma_minutes[w]));
+        e->reqs*=decay;
+        e->bytes*=decay;
+        e->time*=decay;
+      }
+      e->reqs+=1;
+      e->bytes+=(double)bytes;
+      e->time+=(double)response_time;
+    }
+    if (now>st_sb->ewma_time) st_sb->ewma_time=now;
+}
 
-    nowtime = apr_time_now();
-    tu = ts = tcu = tcs = 0;
+/* add the moving averages of a slot, decayed to the monotonic time now */
+static void status_text_ewma_merge(status_text_ewma_t *total,
+                                   const status_text_scoreboard_t *st_sb, apr_time_t now)
+{
+    double elapsed;
+    int w;
 
-    if (!ap_exists_scoreboard_image()) 
+    if (st_sb->ewma_time==0) return;
+    elapsed=(now>st_sb->ewma_time)?(double)(now-st_sb->ewma_time)/APR_USEC_PER_SEC:0;
+
+    for (w = 0; w < STATUS_TEXT_EWMA_WINDOWS; ++w)
     {
-        ap_log_rerror(APLOG_MARK, APLOG_ERR, 0, r,
-                      "Server status unavailable in inetd mode");
-        return HTTP_INTERNAL_SERVER_ERROR;
+      double decay=exp(-elapsed/(60.0*status_text_ewma_minutes[w]));
+      total[w].reqs+=st_sb->ewma[w].reqs*decay;
+      total[w].bytes+=st_sb->ewma[w].bytes*decay;
+      total[w].time+=st_sb->ewma[w].time*decay;
     }
+}
 
-    r->allowed = (AP_METHOD_BIT << M_GET);
-    if (r->method_number != M_GET)
-        return DECLINED;
+/* average response time of a moving average window (in microseconds) */
+#define STATUS_TEXT_EWMA_TIME(e) ((e).reqs>0?(e).time/(e).reqs:0.0)
 
-    ap_set_content_type(r, "text/plain; charset=ISO-8859-1");
+/* get the response time sketch bucket of a response time: the power of two
+ * range (in microseconds) holding it */
+#define STATUS_TEXT_SKETCH_INDEX(t) ((t)>1?status_text_msb((apr_uint64_t)(t)):0)
 
-    for (i = 0; i < server_limit; ++i) 
-    {
-#ifdef HAVE_TIMES
-        clock_t proc_tu = 0, proc_ts = 0, proc_tcu = 0, proc_tcs = 0;
-        clock_t tmp_tu, tmp_ts, tmp_tcu, tmp_tcs;
-#endif
-        ps_record = ap_get_scoreboard_process(i);
-        for (j = 0; j < thread_limit; ++j) 
-	{
-            int indx = (i * thread_limit) + j;
+/* highest response time (in microseconds) of a sketch bucket */
+#define STATUS_TEXT_SKETCH_UPPER(i) ((apr_time_t)((APR_UINT64_C(2)<<(i))-1))
 
-	    /* get the current status text scoreboard */
-	    st_sb_cur=&st_sb[indx];
-
-
-            /* number of request per status code */
-	    st_sb_total.nb_reqs_xxx+=st_sb_cur->nb_reqs_xxx;
-	    st_sb_total.nb_reqs_10x+=st_sb_cur->nb_reqs_10x;
-	    st_sb_total.nb_reqs_200+=st_sb_cur->nb_reqs_200;
-	    st_sb_total.nb_reqs_20x+=st_sb_cur->nb_reqs_20x;
-	    st_sb_total.nb_reqs_301+=st_sb_cur->nb_reqs_301;
-	    st_sb_total.nb_reqs_302+=st_sb_cur->nb_reqs_302;
-	    st_sb_total.nb_reqs_304+=st_sb_cur->nb_reqs_304;
-	    st_sb_total.nb_reqs_30x+=st_sb_cur->nb_reqs_30x;
-	    st_sb_total.nb_reqs_404+=st_sb_cur->nb_reqs_404;
-	    st_sb_total.nb_reqs_40x+=st_sb_cur->nb_reqs_40x;
-	    st_sb_total.nb_reqs_50x+=st_sb_cur->nb_reqs_50x;
-
-	    /* number of bytes per status code */
-	    st_sb_total.nb_bytes_xxx+=st_sb_cur->nb_bytes_xxx;
-	    st_sb_total.nb_bytes_10x+=st_sb_cur->nb_bytes_10x;
-	    st_sb_total.nb_bytes_200+=st_sb_cur->nb_bytes_200;
-	    st_sb_total.nb_bytes_20x+=st_sb_cur->nb_bytes_20x;
-	    st_sb_total.nb_bytes_301+=st_sb_cur->nb_bytes_301;
-	    st_sb_total.nb_bytes_302+=st_sb_cur->nb_bytes_302;
-	    st_sb_total.nb_bytes_304+=st_sb_cur->nb_bytes_304;
-	    st_sb_total.nb_bytes_30x+=st_sb_cur->nb_bytes_30x;
-	    st_sb_total.nb_bytes_404+=st_sb_cur->nb_bytes_404;
-	    st_sb_total.nb_bytes_40x+=st_sb_cur->nb_bytes_40x;
-	    st_sb_total.nb_bytes_50x+=st_sb_cur->nb_bytes_50x;
-
-	    /* number of request per response times range */
-	    st_sb_total.nb_reqs_50ms +=st_sb_cur->nb_reqs_50ms;
-	    st_sb_total.nb_reqs_100ms+=st_sb_cur->nb_reqs_100ms;
-	    st_sb_total.nb_reqs_300ms+=st_sb_cur->nb_reqs_300ms;
-	    st_sb_total.nb_reqs_500ms+=st_sb_cur->nb_reqs_500ms;
-	    st_sb_total.nb_reqs_1s   +=st_sb_cur->nb_reqs_1s;
-	    st_sb_total.nb_reqs_1_5s +=st_sb_cur->nb_reqs_1_5s;
-	    st_sb_total.nb_reqs_2s   +=st_sb_cur->nb_reqs_2s;
-	    st_sb_total.nb_reqs_5s   +=st_sb_cur->nb_reqs_5s;
-	    st_sb_total.nb_reqs_10s  +=st_sb_cur->nb_reqs_10s;
-	    st_sb_total.nb_reqs_15s  +=st_sb_cur->nb_reqs_15s;
-	    st_sb_total.nb_reqs_20s  +=st_sb_cur->nb_reqs_20s;
-	    st_sb_total.nb_reqs_30s  +=st_sb_cur->nb_reqs_30s;
-	    st_sb_total.nb_reqs_xs   +=st_sb_cur->nb_reqs_xs;
+/* atomically add to a 64 bits counter of the shared memory */
+static APR_INLINE void status_text_atomic_add64(apr_uint64_t *mem, apr_uint64_t val)
+{
+#if APR_VERSION_AT_LEAST(1,7,0)
+    apr_atomic_add64((volatile apr_uint64_t *)mem, val);
+#else
+    __sync_fetch_and_add(mem, val);
+#endif
+}
 
-	    #if AP_MODULE_MAGIC_AT_LEAST(20051005,0)
-              ap_copy_scoreboard_worker(&ws_record_st,i, j);
-	    #else
-	      ws_record = ap_get_scoreboard_worker(i, j);
-            #endif
-            res = ws_record->status;
-            stat_buffer[indx] = status_text_flags[res];
+/* atomically raise a 64 bits maximum of the shared memory */
+static APR_INLINE void status_text_atomic_max64(apr_uint64_t *mem, apr_uint64_t val)
+{
+    apr_uint64_t cur;
 
-	    if (res != SERVER_DEAD && res != SERVER_READY  && st_sb_cur->avg>0)
-	    {
-		  /* average response time */
-		  st_sb_total.avg+=st_sb_cur->avg;
-		  nb_avg++;
-	    }
+#if APR_VERSION_AT_LEAST(1,7,0)
+    while ((cur = *(volatile apr_uint64_t *)mem) < val &&
+           apr_atomic_cas64((volatile apr_uint64_t *)mem, val, cur) != cur);
+#else
+    while ((cur = *(volatile apr_uint64_t *)mem) < val &&
+           !__sync_bool_compare_and_swap(mem, cur, val));
+#endif
+}
 
-	    if (res != SERVER_DEAD && st_sb_cur->percentil>0) 
-	    {
-	      /* percentil response time */
-	      percentil_array[nb_percentil]=st_sb_cur->percentil;
-	      nb_percentil++;
-	    }
+/* add a second of a slot to the shared per second ring, without lock: the
+ * first worker that adds a new second to a ring bucket resets it. seconds
+ * older than the ring or than its bucket are dropped. */
+static void status_text_series_flush(const status_text_series_t *pending, apr_uint32_t now_sec)
+{
+    status_text_series_t *e;
+    apr_uint32_t stamp;
+    int tries, i;
 
-            if (!ps_record->quiescing && ps_record->pid) 
-	    {
-                if (res == SERVER_READY
-                    && ps_record->generation == ap_my_generation)
-                    ready++;
-                else if (res != SERVER_DEAD &&
-                         res != SERVER_STARTING &&
-                         res != SERVER_IDLE_KILL)
-                    busy++;
-            }
+    if (!status_text_series || pending->second==0 || pending->reqs==0) return;
+    if (pending->second+status_text_series_seconds<=now_sec) return;
 
-            /* XXX what about the counters for quiescing/seg faulted
-             * processes?  should they be counted or not?  GLA
-             */
-	    lres = ws_record->access_count;
-	    bytes = ws_record->bytes_served;
+    e=&status_text_series[pending->second%status_text_series_seconds];
+    for (tries = 0; ; ++tries)
+    {
+      stamp=apr_atomic_read32(&e->second);
+      if (stamp==pending->second) break;
+      if (tries>=1000) return;
+      if (stamp==STATUS_TEXT_SERIES_RESET) continue; /* reset by another worker */
+      if (stamp>pending->second) return;  /* reused by a later second */
 
-	    if (lres != 0 || (res != SERVER_READY && res != SERVER_DEAD)) 
-	    {
+      if (apr_atomic_cas32(&e->second,STATUS_TEXT_SERIES_RESET,stamp)==stamp)
+      {
+        memset(e->sketch,0,sizeof(e->sketch));
+        e->reqs=e->bytes=e->reqs_4xx=e->reqs_5xx=0;
+        apr_atomic_set32(&e->second,pending->second);
+        break;
+      }
+    }
 
-#ifdef HAVE_TIMES
-		tmp_tu = ws_record->times.tms_utime;
-		tmp_ts = ws_record->times.tms_stime;
-		tmp_tcu = ws_record->times.tms_cutime;
-		tmp_tcs = ws_record->times.tms_cstime;
+    status_text_atomic_add64(&e->reqs,pending->reqs);
+    status_text_atomic_add64(&e->bytes,pending->bytes);
+    if (pending->reqs_4xx) status_text_atomic_add64(&e->reqs_4xx,pending->reqs_4xx);
+    if (pending->reqs_5xx) status_text_atomic_add64(&e->reqs_5xx,pending->reqs_5xx);
+    for (i = 0; i < STATUS_TEXT_SERIES_SKETCH; ++i)
+      if (pending->sketch[i]) apr_atomic_add32(&e->sketch[i],pending->sketch[i]);
+}
 
-		if (times_per_thread) 
-		{
-		    proc_tu += tmp_tu;
-		    proc_ts += tmp_ts;
-		    proc_tcu += tmp_tcu;
-		    proc_tcs += tmp_tcs;
-		} else {
-		    if (tmp_tu > proc_tu ||
-			tmp_ts > proc_ts ||
-			tmp_tcu > proc_tcu ||
-			tmp_tcs > proc_tcs) 
-		    {
-			proc_tu = tmp_tu;
-			proc_ts = tmp_ts;
-			proc_tcu = tmp_tcu;
-			proc_tcs = tmp_tcs;
-		    }
-		}
-#endif /* HAVE_TIMES */
+/* add a second of a slot or of the ring to the time series of the last
+ * nb seconds ending at the second last */
+static void status_text_series_merge(status_text_series_t *series, int nb, apr_uint32_t last,
+                                     const status_text_series_t *e)
+{
+    status_text_series_t *dst;
+    apr_uint32_t second=e->second;
+    int i;
 
-		count += lres;
-		bcount += bytes;
+    if (second==0 || second==STATUS_TEXT_SERIES_RESET || second>last || second+nb<=last) return;
 
-		if (bcount >= KBYTE) 
-		{
-		    kbcount += (bcount >> 10);
-		    bcount = bcount & 0x3ff;
-		}
-	    }
-        }
-#ifdef HAVE_TIMES
-        tu += proc_tu;
-        ts += proc_ts;
-        tcu += proc_tcu;
-        tcs += proc_tcs;
-#endif
-        pid_buffer[i] = ps_record->pid;
-    }
+    dst=&series[nb-1-(last-second)];
+    dst->reqs+=e->reqs;
+    dst->bytes+=e->bytes;
+    dst->reqs_4xx+=e->reqs_4xx;
+    dst->reqs_5xx+=e->reqs_5xx;
+    for (i = 0; i < STATUS_TEXT_SERIES_SKETCH; ++i) dst->sketch[i]+=e->sketch[i];
+}
 
-    /* calculate total average response time */
-    if (nb_avg>0) st_sb_total.avg/=nb_avg;
+/* get a percentile (in per mille) of the response times of a second from
+ * its sketch (in microseconds) */
+static apr_time_t status_text_series_percentile(const status_text_series_t *e, int permille)
+{
+    apr_uint64_t rank, cumul=0;
+    int i;
 
-    /* sort the percentil array (insertion sort algo) */
-    for(i=1;i<nb_percentil;i++)
+    if (e->reqs==0) return 0;
+    rank=(e->reqs*permille+999)/1000;
+    for (i = 0; i < STATUS_TEXT_SERIES_SKETCH-1; ++i)
     {
-      apr_time_t x=percentil_array[i];
-      j=i;
-      while(j>0&&percentil_array[j-1]>x)
-      {
-	percentil_array[j]=percentil_array[j-1];
-	j=j-1;
-      }
-      percentil_array[j]=x;
+      cumul+=e->sketch[i];
+      if (cumul>=rank) break;
     }
-    /* get 90% centil */
-    percentilpos=(unsigned long)((double)(nb_percentil)*0.9);
-    st_sb_total.percentil=percentil_array[percentilpos];
+    return STATUS_TEXT_SKETCH_UPPER(i);
+}
 
-    /* up_time in seconds */
-    up_time = (apr_uint32_t) apr_time_sec(nowtime -
-                               ap_scoreboard_image->global->restart_time);
+/* copy the first len bytes of a status text scoreboard slot and its cold
+ * fields consistently (see the slot seqlock), return the number of copies
+ * retried */
+static int status_text_read_slot(status_text_scoreboard_t *st_sb, status_text_scoreboard_cold_t *st_sb_cold,
+                                 int pos, apr_size_t len)
+{
+    const status_text_scoreboard_t *slot=STATUS_TEXT_SLOT(pos);
+    apr_uint32_t seq;
+    int tries;
+
+    for (tries = 0; ; ++tries)
+    {
+      seq=slot->seq;
+      STATUS_TEXT_READ_BARRIER();
+      memcpy(st_sb,(const void *)slot,len);
+      *st_sb_cold=status_text_scoreboard_cold[pos];
+      STATUS_TEXT_READ_BARRIER();
+
+      /* give up on a thread updating it for too long, keep the last copy */
+      if ((!(seq&1) && seq==slot->seq) || tries>=STATUS_TEXT_READ_TRIES) break;
+    }
+    return tries;
+}
+
+/* add v to a 32 bits counter of a slot being updated (seq is odd), the
+ * counter is first folded in its 64 bits total of the block when it would
+ * reach STATUS_TEXT_FOLD_LIMIT: the fold is between the fold_start and
+ * fold_end increments of the block */
+static APR_INLINE void status_text_count32(status_text_block_t *blk, apr_uint32_t *counter,
+                                           apr_uint64_t *total, apr_uint64_t v)
+{
+    if (v < STATUS_TEXT_FOLD_LIMIT - *counter)
+    {
+      *counter += (apr_uint32_t)v;
+      return;
+    }
+    apr_atomic_inc32(&blk->fold_start);
+    STATUS_TEXT_WRITE_BARRIER();
+    status_text_atomic_add64(total, *counter + v);
+    *counter = 0;
+    STATUS_TEXT_WRITE_BARRIER();
+    apr_atomic_inc32(&blk->fold_end);
+}
+
+/* add a vector of counters to 64 bits totals: plain loops without
+ * dependency between the iterations, vectorized by the compiler (scalar
+ * otherwise) */
+static APR_INLINE void status_text_add_counters32(apr_uint64_t *acc, const apr_uint32_t *v)
+{
+    int k;
+
+    for (k = 0; k < STATUS_TEXT_NB_COUNTERS; ++k)
+      acc[k]+=v[k];
+}
+
+static APR_INLINE void status_text_add_counters(apr_uint64_t *acc, const apr_uint64_t *v)
+{
+    int k;
+
+    for (k = 0; k < STATUS_TEXT_NB_COUNTERS; ++k)
+      acc[k]+=v[k];
+}
+
+/* add the counters of a slot to 64 bits totals */
+static void status_text_add_slot_counters(status_text_block_t *acc, const status_text_scoreboard_t *slot)
+{
+    status_text_add_counters32(acc->counters,slot->counters);
+    acc->time_sum+=slot->time_sum;
+}
+
+/* add the totals of a block to other ones */
+static void status_text_add_block_counters(status_text_block_t *acc, const status_text_block_t *blk)
+{
+    status_text_add_counters(acc->counters,blk->counters);
+    acc->time_sum+=blk->time_sum;
+    if (blk->max>acc->max) acc->max=blk->max;
+}
+
+/* get the totals of the block b and of its nb slots in acc, with a copy of
+ * the first len bytes of the slots and of their cold fields. a fold during the copy would count
+ * its value twice or not at all, the block is then copied again. return
+ * the number of copies retried */
+static int status_text_read_block(status_text_block_t *acc, int b, int nb,
+                                  status_text_scoreboard_t *slots, status_text_scoreboard_cold_t *colds,
+                                  apr_size_t len)
+{
+    const status_text_block_t *blk=STATUS_TEXT_BLOCK(b);
+    apr_uint32_t start, end;
+    int t, tries, retries=0;
+
+    for (tries = 0; ; ++tries)
+    {
+      memset(acc,0,sizeof(status_text_block_t));
+      /* no fold in progress */
+      end=blk->fold_end;
+      STATUS_TEXT_READ_BARRIER();
+      start=blk->fold_start;
+      STATUS_TEXT_READ_BARRIER();
+      if (start!=end && tries<STATUS_TEXT_READ_TRIES) continue;
+
+      status_text_add_block_counters(acc,blk);
+      for (t = 0; t < nb; ++t)
+      {
+        retries+=status_text_read_slot(&slots[t],&colds[t],b*nb+t,len);
+        status_text_add_slot_counters(acc,&slots[t]);
+      }
+
+      /* and none started since */
+      STATUS_TEXT_READ_BARRIER();
+      if (blk->fold_start==start || tries>=STATUS_TEXT_READ_TRIES) break;
+    }
+    return retries+tries;
+}
+
+/* claim a block of slots for the child: a block never claimed, else the
+ * block of a child gone (its statistics are kept, the child adds to them).
+ * return -1 if there is none */
+static int status_text_claim_block(void)
+{
+    apr_uint32_t pid=(apr_uint32_t)getpid(), owner;
+    status_text_block_t *blk;
+    status_text_scoreboard_t *slot;
+    int b, t, pass;
+
+    if (status_text_blocks==NULL) return -1;
+    for (pass = 0; pass < 2; ++pass)
+      for (b = 0; b < status_text_nb_blocks; ++b)
+      {
+        blk=STATUS_TEXT_BLOCK(b);
+        owner=blk->owner;
+        if (pass==0 ? owner!=0
+                    : owner==0 || (owner!=pid && (kill((pid_t)owner,0)==0 || errno!=ESRCH)))
+          continue;
+        if (apr_atomic_cas32(&blk->owner,pid,owner)!=owner) continue;
+        blk->used=1;
+        /* a child killed during an update left an odd seq */
+        for (t = 0; t < status_text_threads; ++t)
+        {
+          slot=STATUS_TEXT_SLOT(b*status_text_threads+t);
+          if (slot->seq&1) slot->seq++;
+        }
+        return b;
+      }
+    return -1;
+}
+
+/* block of the child of pid, -1 if none */
+static int status_text_find_block(pid_t pid)
+{
+    int b;
+
+    if (pid==0 || status_text_blocks==NULL) return -1;
+    for (b = 0; b < status_text_nb_blocks; ++b)
+      if (STATUS_TEXT_BLOCK(b)->owner==(apr_uint32_t)pid) return b;
+    return -1;
+}
+
+/* start the update of a slot shared by the threads of the child: its seq
+ * is made odd with a compare and swap, the other threads wait for it to be
+ * even again. the update only lasts a few hundred nanoseconds, the
+ * threads yield the cpu when it was preempted */
+static void status_text_slot_lock(status_text_scoreboard_t *st_sb)
+{
+    apr_uint32_t seq;
+    int spins;
+
+    for (spins = 1; ; ++spins)
+    {
+      seq=st_sb->seq;
+      if (!(seq&1) && apr_atomic_cas32(&st_sb->seq,seq+1,seq)==seq) return;
+      if (spins%64==0) apr_thread_yield();
+    }
+}
+
+/* count a request of a child without block (or of a thread beyond its
+ * block) in the overflow block, with atomic operations: its slot
+ * statistics (moving averages, percentil windows) do not have it */
+static void status_text_count_overflow(int status, apr_uint64_t bytes, apr_time_t response_time,
+                                       apr_time_t now)
+{
+    status_text_block_t *blk=STATUS_TEXT_BLOCK(status_text_nb_blocks);
+    status_text_series_t one;
+    int code_idx=((unsigned)status<600)?status_text_code_index[status]:0;
+
+    status_text_atomic_add64(&blk->codes[code_idx].reqs,1);
+    status_text_atomic_add64(&blk->codes[code_idx].bytes,bytes);
+    status_text_atomic_add64(&blk->nb_reqs_latency[status_text_latency_index(response_time)],1);
+    status_text_atomic_add64(&blk->hist[status_text_hist_index(response_time)],1);
+    status_text_atomic_add64(&blk->time_sum,response_time);
+    status_text_atomic_max64((apr_uint64_t *)&blk->max,response_time);
+
+    /* a second of one request for the per second ring */
+    memset(&one,0,sizeof(one));
+    one.second=(apr_uint32_t)apr_time_sec(now);
+    one.reqs=1;
+    one.bytes=bytes;
+    if (status>=500) one.reqs_5xx=1;
+    else if (status>=400) one.reqs_4xx=1;
+    one.sketch[STATUS_TEXT_SKETCH_INDEX(response_time)]=1;
+    status_text_series_flush(&one,one.second);
+}
+
+/* record the monotonic start time of the request, backdated to
+ * r->request_time (the time the request line was read) */
+static int status_text_request_start(request_rec *r)
+{
+    apr_time_t *start=apr_palloc(r->pool, sizeof(apr_time_t));
+
+    *start=status_text_monotonic_now()-(apr_time_now()-r->request_time);
+    ap_set_module_config(r->request_config, &status_text_module, start);
+    return DECLINED;
+}
+
+static int runtime_statistique(request_rec *r)
+{
+    /* monotonic start time of the request */
+    apr_time_t *start=ap_get_module_config(r->request_config, &status_text_module);
+
+    /* get scoreboard handle to get current thread and child number */
+    my_sb_handle_t *sb=r->connection->sbh; 
+    /* slot of the thread in the block of the child, or of the child */
+    int shared=(status_text_granularity==STATUS_TEXT_GRANULARITY_PROCESS);
+    int sb_pos=status_text_my_block * status_text_threads + (shared ? 0 : sb->thread_num);
+
+    /* get status text scoreboard share memory */
+    status_text_block_t *blk;
+    status_text_scoreboard_t *st_sb;
+    status_text_scoreboard_cold_t *st_sb_cold;
+
+    /* get the current worker score */
+    /*worker_score *ws = &ap_scoreboard_image->servers[sb->child_num][sb->thread_num];*/
+
+    /* request bytes sent */
+    apr_uint64_t bytes=r->bytes_sent;
+    int code_idx, hist_idx, lat_idx;
+    apr_uint32_t second;
+
+    /* request time duration in microseconds, from the wall clock when the
+     * request failed before post_read_request */
+    apr_time_t now=status_text_monotonic_now();
+    apr_time_t req_response_time;
+    if (start) req_response_time=now-*start;
+    else req_response_time=apr_time_now()-r->request_time;
+    if (req_response_time<0) req_response_time=0;
+
+    /* the worker is in use (see status_text_walk_limit) */
+    status_text_mark_worker(sb->child_num,sb->thread_num);
+
+    /* a child without block, or a thread beyond it */
+    if (status_text_my_block<0 || (!shared && sb->thread_num>=status_text_threads))
+    {
+      status_text_count_overflow(r->status,bytes,req_response_time,now);
+      return OK;
+    }
+    blk=STATUS_TEXT_BLOCK(status_text_my_block);
+    st_sb=STATUS_TEXT_SLOT(sb_pos);
+    st_sb_cold=&status_text_scoreboard_cold[sb_pos];
+
+    /* start of the slot update, seq is odd until its end */
+    if (shared) status_text_slot_lock(st_sb);
+    else st_sb->seq++;
+    STATUS_TEXT_WRITE_BARRIER();
+
+    /* a thread which waited for the lock of a shared slot updates it at
+     * the time it got it, not before the update of the previous thread */
+    if (shared) now=status_text_monotonic_now();
+
+    /* update last response time */
+    st_sb->last=req_response_time;
+
+    /* update the moving averages */
+    status_text_ewma_update(st_sb,now,bytes,req_response_time);
+
+    /* update maximum response time */
+    if (req_response_time>st_sb_cold->max) st_sb_cold->max=req_response_time;
+
+    /* update response time histograms */
+    hist_idx=status_text_hist_index(req_response_time);
+    status_text_count32(blk,&st_sb->hist[hist_idx],&blk->hist[hist_idx],1);
+    st_sb->time_sum+=req_response_time;
+    status_text_window_update(st_sb,now,hist_idx);
+
+    /* request response time distribution */
+    lat_idx=status_text_latency_index(req_response_time);
+    status_text_count32(blk,&st_sb->nb_reqs_latency[lat_idx],&blk->nb_reqs_latency[lat_idx],1);
+
+    /* number of requests/bytes per response status code */
+    code_idx=((unsigned)r->status<600)?status_text_code_index[r->status]:0;
+    status_text_count32(blk,&st_sb->codes[code_idx].reqs,&blk->codes[code_idx].reqs,1);
+    status_text_count32(blk,&st_sb->codes[code_idx].bytes,&blk->codes[code_idx].bytes,bytes);
+
+    /* per second time series: flush the previous second of this slot to
+     * the shared ring at the first request of a new second */
+    second=(apr_uint32_t)apr_time_sec(now);
+    if (second<st_sb->series.second) second=st_sb->series.second;
+    if (st_sb->series.second!=second)
+    {
+      status_text_series_flush(&st_sb->series,second);
+      memset(&st_sb->series,0,sizeof(status_text_series_t));
+      st_sb->series.second=second;
+    }
+    st_sb->series.reqs++;
+    st_sb->series.bytes+=bytes;
+    if (r->status>=500) st_sb->series.reqs_5xx++;
+    else if (r->status>=400) st_sb->series.reqs_4xx++;
+    st_sb->series.sketch[STATUS_TEXT_SKETCH_INDEX(req_response_time)]++;
+
+    /* end of the slot update */
+    STATUS_TEXT_WRITE_BARRIER();
+    st_sb->seq++;
+
+    return OK;
+}
+
+/* get the number of requests (or bytes) of a status code class,
+ * minus the given status code (0 for none) */
+static apr_uint64_t status_text_class_value(const status_text_code_count_t *codes,
+                                            int class, int bytes, int minus)
+{
+    apr_uint64_t value=0;
+    int k;
+
+    for (k = 1; k < STATUS_TEXT_NB_CODES; ++k)
+    {
+      int code=(k<STATUS_TEXT_FIRST_CODE)?k*100:status_text_codes[k-STATUS_TEXT_FIRST_CODE];
+      if (code/100!=class || code==minus) continue;
+      value+=bytes?codes[k].bytes:codes[k].reqs;
+    }
+    return value;
+}
+
+/* get the number of requests (or bytes) of a status code key suffix:
+ * a status code ("503"), a class ("5xx"), the codes of a class without
+ * their own counter ("5xx_Other") or an historical key ("xxx", "10x",
+ * "20x", "30x", "40x", "50x"). return 0 if the key suffix is unknown.
+ */
+static int status_text_code_value(const status_text_code_count_t *codes,
+                                  const char *name, int bytes, apr_uint64_t *value)
+{
+    int class, code, idx;
+
+    if (strcasecmp(name,"xxx")==0)
+    {
+      *value=bytes?codes[0].bytes:codes[0].reqs;
+      return 1;
+    }
+    if (name[0]<'1' || name[0]>'5' || strlen(name)<3) return 0;
+    class=name[0]-'0';
+
+    if (strcasecmp(name+1,"xx")==0)
+    {
+      *value=status_text_class_value(codes,class,bytes,0);
+      return 1;
+    }
+    if (strcasecmp(name+1,"xx_Other")==0)
+    {
+      *value=bytes?codes[class].bytes:codes[class].reqs;
+      return 1;
+    }
+    if (strcasecmp(name+1,"0x")==0)
+    {
+      switch (class)
+      {
+	case 2:
+	  *value=status_text_class_value(codes,2,bytes,200);
+	  break;
+	case 3:
+	  *value=status_text_class_value(codes,3,bytes,0)
+	    -(bytes?codes[status_text_code_index[301]].bytes:codes[status_text_code_index[301]].reqs)
+	    -(bytes?codes[status_text_code_index[302]].bytes:codes[status_text_code_index[302]].reqs)
+	    -(bytes?codes[status_text_code_index[304]].bytes:codes[status_text_code_index[304]].reqs);
+	  break;
+	case 4:
+	  *value=status_text_class_value(codes,4,bytes,404);
+	  break;
+	default:
+	  *value=status_text_class_value(codes,class,bytes,0);
+	  break;
+      }
+      return 1;
+    }
+    if (name[3]!='\0' || !apr_isdigit(name[1]) || !apr_isdigit(name[2])) return 0;
+
+    /* a status code with its own counter */
+    code=atoi(name);
+    idx=status_text_code_index[code];
+    if (idx<STATUS_TEXT_FIRST_CODE) return 0;
+    *value=bytes?codes[idx].bytes:codes[idx].reqs;
+    return 1;
+}
+
+/* output buffer of the handler: the output is formatted in large chunks
+ * passed to the output filters as heap buckets, instead of an ap_rprintf
+ * per value. the integers and the response times are converted without
+ * the formatter.
+ */
+#define STATUS_TEXT_BUF_SIZE     65536    /* size of the next chunks */
+#define STATUS_TEXT_BUF_MAX_SIZE 4194304  /* maximum size of the first chunk */
+#define STATUS_TEXT_BUF_KEY      64       /* estimated size of a key line */
+#define STATUS_TEXT_BUF_WORKER   160      /* estimated size of a worker line */
+#define STATUS_TEXT_BUF_PRINTF   128      /* longest status_text_buf_printf output */
+
+typedef struct {
+    request_rec *r;
+    apr_bucket_brigade *bb;
+    char *buf;        /* current chunk */
+    apr_size_t len;   /* length of the current chunk */
+    apr_size_t size;  /* size of the current chunk */
+    apr_size_t mark;  /* start of the output that may be dropped, or STATUS_TEXT_BUF_NO_MARK */
+} status_text_buf_t;
+
+#define STATUS_TEXT_BUF_NO_MARK ((apr_size_t)-1)
+
+static const char status_text_digits[] =
+    "00010203040506070809101112131415161718192021222324252627282930313233343536373839"
+    "40414243444546474849505152535455565758596061626364656667686970717273747576777879"
+    "8081828384858687888990919293949596979899";
+
+static void status_text_buf_init(status_text_buf_t *b, request_rec *r, apr_size_t size)
+{
+    b->r = r;
+    b->bb = apr_brigade_create(r->pool, r->connection->bucket_alloc);
+    if (size > STATUS_TEXT_BUF_MAX_SIZE) size = STATUS_TEXT_BUF_MAX_SIZE;
+    if (size < APR_BUCKET_BUFF_SIZE) size = APR_BUCKET_BUFF_SIZE;
+    b->buf = apr_bucket_alloc(size, r->connection->bucket_alloc);
+    b->len = 0;
+    b->size = size;
+    b->mark = STATUS_TEXT_BUF_NO_MARK;
+}
+
+/* make room for n bytes: the current chunk goes to the brigade, but the
+ * output since the mark which is moved to the next chunk */
+static void status_text_buf_grow(status_text_buf_t *b, apr_size_t n)
+{
+    apr_bucket_alloc_t *ba = b->r->connection->bucket_alloc;
+    apr_size_t keep = b->mark == STATUS_TEXT_BUF_NO_MARK ? b->len : b->mark;
+    apr_size_t tail = b->len - keep;
+    char *buf = b->buf;
+
+    b->size = n + tail > STATUS_TEXT_BUF_SIZE ? n + tail : STATUS_TEXT_BUF_SIZE;
+    b->buf = apr_bucket_alloc(b->size, ba);
+    memcpy(b->buf, buf + keep, tail);
+    b->len = tail;
+    if (b->mark != STATUS_TEXT_BUF_NO_MARK) b->mark = 0;
+
+    if (keep)
+      APR_BRIGADE_INSERT_TAIL(b->bb, apr_bucket_heap_create(buf, keep, apr_bucket_free, ba));
+    else
+      apr_bucket_free(buf);
+}
+
+#define STATUS_TEXT_BUF_RESERVE(b, n) \
+    do { if ((b)->len + (n) > (b)->size) status_text_buf_grow((b), (n)); } while (0)
+
+/* mark the start of an output that may be dropped by
+ * status_text_buf_rollback, until status_text_buf_unmark */
+#define status_text_buf_mark(b) ((b)->mark = (b)->len)
+#define status_text_buf_unmark(b) ((b)->mark = STATUS_TEXT_BUF_NO_MARK)
+#define status_text_buf_rollback(b) ((b)->len = (b)->mark, (b)->mark = STATUS_TEXT_BUF_NO_MARK)
+
+/* pass the output to the filters */
+static apr_status_t status_text_buf_flush(status_text_buf_t *b)
+{
+    if (b->len)
+      APR_BRIGADE_INSERT_TAIL(b->bb, apr_bucket_heap_create(b->buf, b->len, apr_bucket_free,
+                                                           b->r->connection->bucket_alloc));
+    else
+      apr_bucket_free(b->buf);
+    b->buf = NULL;
+    b->len = b->size = 0;
+    return ap_pass_brigade(b->r->output_filters, b->bb);
+}
+
+static APR_INLINE void status_text_buf_putsn(status_text_buf_t *b, const char *s, apr_size_t n)
+{
+    STATUS_TEXT_BUF_RESERVE(b, n);
+    memcpy(b->buf + b->len, s, n);
+    b->len += n;
+}
+
+static APR_INLINE void status_text_buf_puts(status_text_buf_t *b, const char *s)
+{
+    status_text_buf_putsn(b, s, strlen(s));
+}
+
+static APR_INLINE void status_text_buf_putc(status_text_buf_t *b, char c)
+{
+    STATUS_TEXT_BUF_RESERVE(b, 1);
+    b->buf[b->len++] = c;
+}
+
+/* strings until NULL, as ap_rvputs */
+static void status_text_buf_vputs(status_text_buf_t *b, ...)
+{
+    va_list va;
+    const char *s;
+
+    va_start(va, b);
+    while ((s = va_arg(va, const char *)) != NULL)
+      status_text_buf_puts(b, s);
+    va_end(va);
+}
+
+/* unsigned integer in decimal, two digits at a time */
+static void status_text_buf_u64(status_text_buf_t *b, apr_uint64_t v)
+{
+    char tmp[20];
+    char *p = tmp + sizeof(tmp);
+
+    while (v >= 100)
+    {
+      unsigned d = (unsigned)(v % 100) * 2;
+      v /= 100;
+      *--p = status_text_digits[d + 1];
+      *--p = status_text_digits[d];
+    }
+    if (v >= 10)
+    {
+      *--p = status_text_digits[v * 2 + 1];
+      *--p = status_text_digits[v * 2];
+    }
+    else
+      *--p = '0' + (char)v;
+    status_text_buf_putsn(b, p, tmp + sizeof(tmp) - p);
+}
+
+static void status_text_buf_i64(status_text_buf_t *b, apr_int64_t v)
+{
+    if (v < 0)
+    {
+      status_text_buf_putc(b, '-');
+      status_text_buf_u64(b, -(apr_uint64_t)v);
+    }
+    else
+      status_text_buf_u64(b, (apr_uint64_t)v);
+}
+
+static void status_text_buf_printf(status_text_buf_t *b, const char *fmt, ...)
+    __attribute__((format(printf, 2, 3)));
+
+/* formatted output of at most STATUS_TEXT_BUF_PRINTF bytes, for the
+ * floating point values */
+static void status_text_buf_printf(status_text_buf_t *b, const char *fmt, ...)
+{
+    va_list va;
+
+    STATUS_TEXT_BUF_RESERVE(b, STATUS_TEXT_BUF_PRINTF);
+    va_start(va, fmt);
+    b->len += apr_vsnprintf(b->buf + b->len, STATUS_TEXT_BUF_PRINTF, fmt, va);
+    va_end(va);
+}
+
+/* value with 3 decimals, as "%.3f" (the response times in ms) */
+static void status_text_buf_fixed3(status_text_buf_t *b, double v)
+{
+    apr_uint64_t t;
+
+    if (!(v > -9e15 && v < 9e15))
+    {
+      status_text_buf_printf(b, "%.3f", v);
+      return;
+    }
+    if (v < 0)
+    {
+      v = -v;
+      if (v >= 0.0005) status_text_buf_putc(b, '-');
+    }
+    t = (apr_uint64_t)(v * 1000.0 + 0.5);
+    status_text_buf_u64(b, t / 1000);
+    t %= 1000;
+    STATUS_TEXT_BUF_RESERVE(b, 4);
+    b->buf[b->len++] = '.';
+    b->buf[b->len++] = '0' + (char)(t / 100);
+    b->buf[b->len++] = status_text_digits[(t % 100) * 2];
+    b->buf[b->len++] = status_text_digits[(t % 100) * 2 + 1];
+}
+
+/* html escaped string, as ap_escape_html, and first escaped as
+ * ap_escape_logitem when logitem is set, in a single pass */
+static void status_text_buf_escaped(status_text_buf_t *b, const char *s, int logitem)
+{
+    const unsigned char *c;
+    const char *run, *esc;
+    char hex[5];
+
+    if (s == NULL) return;
+    for (c = (const unsigned char *)s, run = s; *c; ++c)
+    {
+      esc = NULL;
+      if (logitem && (*c < 0x20 || *c >= 0x7f || *c == '"' || *c == '\\'))
+      {
+        switch (*c)
+        {
+          case '\b': esc = "\\b"; break;
+          case '\n': esc = "\\n"; break;
+          case '\r': esc = "\\r"; break;
+          case '\t': esc = "\\t"; break;
+          case '\v': esc = "\\v"; break;
+          case '\\': esc = "\\\\"; break;
+          case '"': esc = "\\&quot;"; break;
+          default:
+            hex[0] = '\\';
+            hex[1] = 'x';
+            hex[2] = "0123456789abcdef"[*c >> 4];
+            hex[3] = "0123456789abcdef"[*c & 0xf];
+            hex[4] = '\0';
+            esc = hex;
+        }
+      }
+      else
+        switch (*c)
+        {
+          case '<': esc = "&lt;"; break;
+          case '>': esc = "&gt;"; break;
+          case '&': esc = "&amp;"; break;
+          case '"': esc = "&quot;"; break;
+        }
+      if (esc == NULL) continue;
+      /* the characters not escaped since the last escaped one */
+      status_text_buf_putsn(b, run, (const char *)c - run);
+      status_text_buf_puts(b, esc);
+      run = (const char *)c + 1;
+    }
+    status_text_buf_putsn(b, run, (const char *)c - run);
+}
+
+/* per second time series keys */
+static const char *status_text_series_keys[] = {
+    "Apache_Max_RPS", "Apache_RPS_Series", "Apache_Bytes_Series", "Apache_4xx_Series",
+    "Apache_5xx_Series", "Apache_P99_ResponseTime_Series", NULL
+};
+
+/* print the value of the per second time series key which (index in
+ * status_text_series_keys): oldest second first, comma separated */
+static void status_text_print_series(status_text_buf_t *out, int which,
+                                     const status_text_series_t *series, int nb)
+{
+    int k;
+
+    if (which==0)
+    {
+      apr_uint64_t max=0;
+      for (k = 0; k < nb; ++k) if (series[k].reqs>max) max=series[k].reqs;
+      status_text_buf_u64(out, max);
+      return;
+    }
+
+    for (k = 0; k < nb; ++k)
+    {
+      if (k) status_text_buf_puts(out, ",");
+      switch (which)
+      {
+        case 1: status_text_buf_u64(out, series[k].reqs); break;
+        case 2: status_text_buf_u64(out, series[k].bytes); break;
+        case 3: status_text_buf_u64(out, series[k].reqs_4xx); break;
+        case 4: status_text_buf_u64(out, series[k].reqs_5xx); break;
+        default: status_text_buf_fixed3(out, STATUS_TEXT_MSEC(status_text_series_percentile(&series[k],990)));
+      }
+    }
+}
+
+/* parts of the aggregated statistics needed by the keys */
+#define STATUS_TEXT_NEED_WORKERS    1  /* apache scoreboard: accesses, kbytes, busy/idle workers */
+#define STATUS_TEXT_NEED_CPU        2  /* apache scoreboard cpu times */
+#define STATUS_TEXT_NEED_SLOTS      4  /* status text scoreboard counters */
+#define STATUS_TEXT_NEED_PERCENTILS 8  /* sliding windows percentils */
+#define STATUS_TEXT_NEED_SERIES     16 /* per second time series */
+#define STATUS_TEXT_NEED_ALL        31
+
+/* aggregated statistics of all the slots and of the apache scoreboard,
+ * a single block (the time series at its end) so it can be cached and
+ * copied with memcpy (see status_text_get_snapshot) */
+typedef struct {
+    apr_time_t monotonic_time; /* monotonic time of the aggregation */
+    int needs; /* parts aggregated (STATUS_TEXT_NEED_*) */
+    int ready;
+    int busy;
+    apr_uint64_t count;
+    apr_uint64_t kbcount;
+    clock_t tu, ts, tcu, tcs;
+    union {
+      struct {
+        status_text_code_count_t codes[STATUS_TEXT_NB_CODES];
+        apr_uint64_t nb_reqs_latency[STATUS_TEXT_MAX_LATENCY_BUCKETS];
+        apr_uint64_t hist[STATUS_TEXT_HIST_BUCKETS];
+      };
+      apr_uint64_t counters[STATUS_TEXT_NB_COUNTERS];
+    };
+    apr_uint64_t time_sum;
+    status_text_ewma_t ewma[STATUS_TEXT_EWMA_WINDOWS];
+    apr_time_t percentil[STATUS_TEXT_WINDOWS][STATUS_TEXT_NB_PERCENTILS];
+    apr_time_t max_response_time;
+    apr_uint64_t read_retries;
+    /* per second time series of the last complete seconds */
+    status_text_series_t series[1]; /* status_text_series_seconds seconds */
+} status_text_snapshot_t;
+
+/* size of a snapshot with its time series */
+#define STATUS_TEXT_SNAPSHOT_SIZE (APR_OFFSETOF(status_text_snapshot_t, series) + \
+        (status_text_series_seconds + 1) * sizeof(status_text_series_t))
+
+/* StatusTextCacheTTL: the snapshot of the child is reused during this time,
+ * the scrapers arriving while it is computed wait for it */
+static apr_interval_time_t status_text_cache_ttl = 0;
+static status_text_snapshot_t *status_text_cache = NULL;
+static int status_text_cache_valid = 0;
+#if APR_HAS_THREADS
+static apr_thread_mutex_t *status_text_cache_mutex = NULL;
+#endif
+
+/* StatusTextAggregateInterval: the helper process aggregates a snapshot
+ * at each interval in one of two buffers after the delta entries, the
+ * handler copies the last one out (see status_text_agg_copy). writing is
+ * the sequence number of the buffer being written, seq the last one
+ * published, the buffer of a sequence number is seq & 1 */
+typedef struct {
+    volatile apr_uint32_t seq;
+    volatile apr_uint32_t writing;
+} status_text_agg_t;
+
+status_text_agg_t *status_text_agg = NULL;
+static apr_size_t status_text_agg_size; /* cache line padded snapshot size */
+static apr_interval_time_t status_text_agg_interval = 0;
+
+#define STATUS_TEXT_AGG_BUFFER(i) ((status_text_snapshot_t *)((char *)status_text_agg + \
+        STATUS_TEXT_CACHE_LINE + (apr_size_t)(i) * status_text_agg_size))
+#define STATUS_TEXT_AGG_TRIES 3
+
+/* cpu times of a child (see status_text_count_worker) */
+typedef struct {
+    clock_t tu, ts, tcu, tcs;
+} status_text_cpu_t;
+
+/* add a worker of the apache scoreboard to the worker keys of a snapshot
+ * (ready and busy workers, accesses, bytes with *bcount the bytes not yet
+ * counted in kbcount) and, with STATUS_TEXT_NEED_CPU, its cpu times to
+ * the ones of its child */
+static void status_text_count_worker(status_text_snapshot_t *snap, const process_score *ps_record,
+                                     const worker_score *ws_record, ap_generation_t generation,
+                                     status_text_cpu_t *proc, apr_uint64_t *bcount)
+{
+    int res = ws_record->status;
+    apr_uint64_t lres, bytes;
+#ifdef HAVE_TIMES
+    int times_per_thread = getpid() != child_pid;
+    clock_t tmp_tu, tmp_ts, tmp_tcu, tmp_tcs;
+#endif
+
+    if (!ps_record->quiescing && ps_record->pid) 
+    {
+        if (res == SERVER_READY
+            && ps_record->generation == generation)
+            snap->ready++;
+        else if (res != SERVER_DEAD &&
+                 res != SERVER_STARTING &&
+                 res != SERVER_IDLE_KILL)
+            snap->busy++;
+    }
+
+    /* XXX what about the counters for quiescing/seg faulted
+     * processes?  should they be counted or not?  GLA
+     */
+    lres = ws_record->access_count;
+    bytes = ws_record->bytes_served;
+
+    if (lres != 0 || (res != SERVER_READY && res != SERVER_DEAD)) 
+    {
+
+#ifdef HAVE_TIMES
+      if (snap->needs & STATUS_TEXT_NEED_CPU)
+      {
+	tmp_tu = ws_record->times.tms_utime;
+	tmp_ts = ws_record->times.tms_stime;
+	tmp_tcu = ws_record->times.tms_cutime;
+	tmp_tcs = ws_record->times.tms_cstime;
+
+	if (times_per_thread) 
+	{
+	    proc->tu += tmp_tu;
+	    proc->ts += tmp_ts;
+	    proc->tcu += tmp_tcu;
+	    proc->tcs += tmp_tcs;
+	} else {
+	    if (tmp_tu > proc->tu ||
+		tmp_ts > proc->ts ||
+		tmp_tcu > proc->tcu ||
+		tmp_tcs > proc->tcs) 
+	    {
+		proc->tu = tmp_tu;
+		proc->ts = tmp_ts;
+		proc->tcu = tmp_tcu;
+		proc->tcs = tmp_tcs;
+	    }
+	}
+      }
+#endif /* HAVE_TIMES */
+
+	snap->count += lres;
+	*bcount += bytes;
+
+	if (*bcount >= KBYTE) 
+	{
+	    snap->kbcount += (*bcount >> 10);
+	    *bcount = *bcount & 0x3ff;
+	}
+    }
+}
+
+/* add the cpu times of a child to a snapshot */
+static void status_text_count_process(status_text_snapshot_t *snap, const status_text_cpu_t *proc)
+{
+#ifdef HAVE_TIMES
+    snap->tu += proc->tu;
+    snap->ts += proc->ts;
+    snap->tcu += proc->tcu;
+    snap->tcs += proc->tcs;
+#endif
+}
+
+/* aggregate the status text scoreboard and the apache scoreboard, only the
+ * parts in needs (STATUS_TEXT_NEED_*) */
+static void status_text_aggregate(status_text_snapshot_t *snap, apr_pool_t *p, int needs)
+{
+    int j, i, k, b, t, nb, marked_only;
+    apr_uint64_t bcount;
+    worker_score ws_record_st;
+    worker_score *ws_record=&ws_record_st;
+    process_score *ps_record;
+    status_text_cpu_t proc;
+    apr_uint32_t series_last;
+    double *window_hist=NULL;
+
+    bcount = 0;
+    memset(snap,0,STATUS_TEXT_SNAPSHOT_SIZE);
+    snap->needs = needs;
+
+#if AP_MODULE_MAGIC_AT_LEAST(20090401,1)
+    ap_generation_t ap_my_generation;
+    ap_mpm_query(AP_MPMQ_GENERATION, &ap_my_generation);
+#endif
+
+    snap->monotonic_time = status_text_monotonic_now();
+
+    /* per second time series of the last complete seconds */
+    series_last = (apr_uint32_t)apr_time_sec(snap->monotonic_time) - 1;
+    if (needs & STATUS_TEXT_NEED_SERIES)
+      for (k = 0; k < status_text_series_seconds; ++k)
+        status_text_series_merge(snap->series,status_text_series_seconds,series_last,&status_text_series[k]);
+    /* sliding windows histograms */
+    if (needs & STATUS_TEXT_NEED_PERCENTILS)
+      window_hist = apr_pcalloc(p, STATUS_TEXT_WINDOWS * STATUS_TEXT_HIST_BUCKETS * sizeof(double));
+
+    /* the blocks of slots in use, and the overflow block */
+    if (needs & STATUS_TEXT_NEED_SLOTS)
+    {
+      status_text_block_t *acc = apr_palloc(p, sizeof(status_text_block_t));
+      status_text_scoreboard_t *slots = apr_palloc(p, status_text_threads * sizeof(status_text_scoreboard_t));
+      /* the windows histograms are only copied for the percentils */
+      apr_size_t len = (needs & STATUS_TEXT_NEED_PERCENTILS) ? sizeof(status_text_scoreboard_t)
+                                                             : STATUS_TEXT_SLOT_HOT_SIZE;
+      status_text_scoreboard_cold_t *colds = apr_palloc(p, status_text_threads * sizeof(status_text_scoreboard_cold_t));
+
+      for (b = 0; b <= status_text_nb_blocks; ++b)
+      {
+        nb = (b < status_text_nb_blocks) ? status_text_threads : 0;
+        if (nb && !STATUS_TEXT_BLOCK(b)->used) continue;
+        snap->read_retries+=status_text_read_block(acc,b,nb,slots,colds,len);
+
+        /* number of request and bytes per status code, per response times
+         * range and response time histogram */
+        status_text_add_counters(snap->counters,acc->counters);
+        snap->time_sum+=acc->time_sum;
+        if (acc->max>snap->max_response_time)
+          snap->max_response_time=acc->max;
+
+        for (t = 0; t < nb; ++t)
+        {
+          /* merge the moving averages */
+          status_text_ewma_merge(snap->ewma,&slots[t],snap->monotonic_time);
+
+          /* merge the current second not yet in the ring */
+          if (needs & STATUS_TEXT_NEED_SERIES)
+            status_text_series_merge(snap->series,status_text_series_seconds,series_last,&slots[t].series);
+
+          if (colds[t].max>snap->max_response_time)
+            snap->max_response_time=colds[t].max;
+          if (needs & STATUS_TEXT_NEED_PERCENTILS)
+            for (k = 0; k < STATUS_TEXT_WINDOWS; ++k)
+              status_text_window_merge(window_hist+k*STATUS_TEXT_HIST_BUCKETS,&slots[t],k,snap->monotonic_time);
+        }
+      }
+    }
+
+    /* the workers of the apache scoreboard in use */
+    if (needs & (STATUS_TEXT_NEED_WORKERS|STATUS_TEXT_NEED_CPU))
+      for (i = 0; i < server_limit; ++i) 
+      {
+        ps_record = ap_get_scoreboard_process(i);
+        nb = status_text_walk_limit(i, ps_record, &marked_only);
+        memset(&proc, 0, sizeof(proc));
+        for (j = 0; j < nb; ++j) 
+        {
+          if (marked_only && !status_text_worker_marked(i, j)) continue;
+	  #if AP_MODULE_MAGIC_AT_LEAST(20051005,0)
+            ap_copy_scoreboard_worker(&ws_record_st,i, j);
+	  #else
+	    ws_record = ap_get_scoreboard_worker(i, j);
+          #endif
+          status_text_count_worker(snap, ps_record, ws_record, ap_my_generation, &proc, &bcount);
+        }
+        status_text_count_process(snap, &proc);
+      }
+
+    /* get percentils from the merged sliding windows histograms */
+    if (needs & STATUS_TEXT_NEED_PERCENTILS)
+      for (k = 0; k < STATUS_TEXT_WINDOWS; ++k)
+        for (i = 0; i < STATUS_TEXT_NB_PERCENTILS; ++i)
+          snap->percentil[k][i]=status_text_window_percentile(window_hist+k*STATUS_TEXT_HIST_BUCKETS,
+                                                       status_text_percentil_permille[i],
+                                                       snap->max_response_time);
+}
+
+/* copy the last snapshot of the helper, fails when there is none yet, when
+ * it misses a part in needs, when it is stale (the helper is late or gone)
+ * or when the helper kept overwriting it during the copies */
+static int status_text_agg_copy(status_text_snapshot_t *snap, int needs)
+{
+    apr_uint32_t seq;
+    int tries;
+
+    if (status_text_agg == NULL || STATUS_TEXT_SNAPSHOT_SIZE > status_text_agg_size)
+      return 0;
+    for (tries = 0; tries < STATUS_TEXT_AGG_TRIES; ++tries)
+    {
+      seq = status_text_agg->seq;
+      if (seq == 0) return 0;
+      STATUS_TEXT_READ_BARRIER();
+      memcpy(snap, STATUS_TEXT_AGG_BUFFER(seq & 1), STATUS_TEXT_SNAPSHOT_SIZE);
+      STATUS_TEXT_READ_BARRIER();
+      /* the buffer is only rewritten from the sequence number seq + 2 */
+      if (status_text_agg->writing - seq <= 1) break;
+    }
+    if (tries == STATUS_TEXT_AGG_TRIES) return 0;
+    if ((snap->needs & needs) != needs) return 0;
+    return status_text_monotonic_now() - snap->monotonic_time <= 2 * status_text_agg_interval + apr_time_from_sec(1);
+}
+
+/* get the aggregated statistics needed, from the helper process when
+ * StatusTextAggregateInterval is set, else from the cache of the child when
+ * StatusTextCacheTTL is set and it is not older (the cache has them all) */
+static status_text_snapshot_t *status_text_get_snapshot(request_rec *r, int needs)
+{
+    status_text_snapshot_t *snap = apr_palloc(r->pool, STATUS_TEXT_SNAPSHOT_SIZE);
+
+    if (status_text_agg_copy(snap, needs))
+      return snap;
+    if (status_text_cache_ttl <= 0 || status_text_cache == NULL)
+    {
+      status_text_aggregate(snap, r->pool, needs);
+      return snap;
+    }
+
+#if APR_HAS_THREADS
+    if (status_text_cache_mutex) apr_thread_mutex_lock(status_text_cache_mutex);
+#endif
+    if (!status_text_cache_valid ||
+        status_text_monotonic_now() - status_text_cache->monotonic_time >= status_text_cache_ttl)
+    {
+      status_text_aggregate(status_text_cache, r->pool, STATUS_TEXT_NEED_ALL);
+      status_text_cache_valid = 1;
+    }
+    memcpy(snap, status_text_cache, STATUS_TEXT_SNAPSHOT_SIZE);
+#if APR_HAS_THREADS
+    if (status_text_cache_mutex) apr_thread_mutex_unlock(status_text_cache_mutex);
+#endif
+    return snap;
+}
+
+/* static values, computed once at post_config (see status_text_init_static) */
+static struct {
+    const char *server_version;
+    const char *server_built;
+    const char *apr_version;
+    const char *apu_version;
+    const char *mpm;
+    const char *config_file;
+    int nb_listen;
+    const char **listen; /* protocol://host:port per listener, NULL if not active */
+} status_text_static;
+
+static void status_text_init_static(apr_pool_t *p)
+{
+    ap_listen_rec *lr;
+    int k;
+
+    status_text_static.server_version = AP_SERVER_BASEVERSION " (" PLATFORM ")";
+    status_text_static.server_built = apr_pstrdup(p, ap_get_server_built());
+    status_text_static.apr_version = apr_pstrdup(p, apr_version_string());
+    status_text_static.apu_version = apr_pstrdup(p, apu_version_string());
+    status_text_static.mpm = apr_pstrdup(p, ap_show_mpm());
+    status_text_static.config_file = apr_pstrdup(p, ap_conftree->filename);
+
+    status_text_static.nb_listen = 0;
+    for (lr = ap_listeners; lr != NULL; lr = lr->next) status_text_static.nb_listen++;
+    status_text_static.listen = apr_pcalloc(p, (status_text_static.nb_listen + 1) * sizeof(char *));
+    for (lr = ap_listeners, k = 0; lr != NULL; lr = lr->next, k++)
+      if (lr->active)
+        status_text_static.listen[k] = apr_psprintf(p, "%s://%s:%d", lr->protocol,
+                                                    lr->bind_addr->hostname ? lr->bind_addr->hostname : "0.0.0.0",
+                                                    lr->bind_addr->port);
+}
+
+/* statistics keys: every key the handler knows is described once in
+ * status_text_keys (in the order of the full output), built at post_config
+ * with the keys depending on the configuration (listeners, status codes,
+ * response time ranges...), and looked up by name with a binary search in
+ * status_text_sorted_keys. the output formats (text, prometheus, json) are
+ * all printed from it. */
+enum {
+    STATUS_TEXT_KEY_MODULE_VERSION,
+    STATUS_TEXT_KEY_SERVER_ROOT,
+    STATUS_TEXT_KEY_DOCUMENT_ROOT,
+    STATUS_TEXT_KEY_CONFIG_FILE,
+    STATUS_TEXT_KEY_SERVER_NAME,
+    STATUS_TEXT_KEY_SERVER_PORT,
+    STATUS_TEXT_KEY_LISTEN_COUNT,
+    STATUS_TEXT_KEY_LISTEN,
+    STATUS_TEXT_KEY_SERVER_VERSION,
+    STATUS_TEXT_KEY_SERVER_BUILT,
+    STATUS_TEXT_KEY_APR_VERSION,
+    STATUS_TEXT_KEY_APR_BUILD_VERSION,
+    STATUS_TEXT_KEY_APU_VERSION,
+    STATUS_TEXT_KEY_APU_BUILD_VERSION,
+    STATUS_TEXT_KEY_MPM,
+    STATUS_TEXT_KEY_THREADED,
+    STATUS_TEXT_KEY_FORKED,
+    STATUS_TEXT_KEY_ARCHITECTURE,
+    STATUS_TEXT_KEY_TIMEOUT,
+    STATUS_TEXT_KEY_KEEPALIVE_TIMEOUT,
+    STATUS_TEXT_KEY_GENERATION,
+    STATUS_TEXT_KEY_CURRENT_TIME,
+    STATUS_TEXT_KEY_RESTART_TIME,
+    STATUS_TEXT_KEY_UPTIME,
+    STATUS_TEXT_KEY_CODE_REQS,
+    STATUS_TEXT_KEY_CODE_BYTES,
+    STATUS_TEXT_KEY_LATENCY,
+    STATUS_TEXT_KEY_AVG_RESPONSE_TIME,
+    STATUS_TEXT_KEY_REQS_PER_SEC,
+    STATUS_TEXT_KEY_BYTES_PER_SEC,
+    STATUS_TEXT_KEY_PERCENTIL,
+    STATUS_TEXT_KEY_MAX_RESPONSE_TIME,
+    STATUS_TEXT_KEY_HISTOGRAM,
+    STATUS_TEXT_KEY_SNAPSHOT_RETRIES,
+    STATUS_TEXT_KEY_SERIES_SECONDS,
+    STATUS_TEXT_KEY_SERIES,
+    STATUS_TEXT_KEY_TOTAL_ACCESSES,
+    STATUS_TEXT_KEY_TOTAL_KBYTES,
+    STATUS_TEXT_KEY_THREAD_LIMIT,
+    STATUS_TEXT_KEY_SERVER_LIMIT,
+    STATUS_TEXT_KEY_MAX_WORKER,
+    STATUS_TEXT_KEY_BUSY_WORKERS,
+    STATUS_TEXT_KEY_IDLE_WORKERS,
+    STATUS_TEXT_KEY_CPU_USER,
+    STATUS_TEXT_KEY_CPU_SYSTEM,
+    STATUS_TEXT_KEY_CHILD_CPU_USER,
+    STATUS_TEXT_KEY_CHILD_CPU_SYSTEM,
+    STATUS_TEXT_KEY_CPU_LOAD
+};
+
+/* types of the keys values */
+#define STATUS_TEXT_TYPE_STRING    0
+#define STATUS_TEXT_TYPE_GAUGE     1
+#define STATUS_TEXT_TYPE_COUNTER   2
+#define STATUS_TEXT_TYPE_SERIES    3 /* comma separated values */
+#define STATUS_TEXT_TYPE_HISTOGRAM 4 /* upper_bound:count values */
+
+/* keys flags */
+#define STATUS_TEXT_KEY_QUERY_ONLY 1 /* not in the full output */
+#define STATUS_TEXT_KEY_OPTIONAL   2 /* in the full output only when not empty */
+#define STATUS_TEXT_KEY_ALIAS      4 /* same value as another key */
+
+/* output formats */
+#define STATUS_TEXT_FORMAT_TEXT       0
+#define STATUS_TEXT_FORMAT_PROMETHEUS 1
+#define STATUS_TEXT_FORMAT_JSON       2
+#define STATUS_TEXT_FORMAT_BINARY     3 /* see status_text_binary.h */
+
+typedef struct {
+    const char *name;
+    const char *list_name; /* name in the full text output if not name */
+    int id;     /* STATUS_TEXT_KEY_* */
+    int type;   /* STATUS_TEXT_TYPE_* */
+    int flags;  /* STATUS_TEXT_KEY_* flags */
+    int needs;  /* parts of the aggregated statistics needed (STATUS_TEXT_NEED_*) */
+    int arg;    /* listener, counter, response time range, window or series index */
+    int arg2;   /* percentil index */
+    int family; /* prometheus metric family, -1 if not exported */
+    const char *labels; /* prometheus labels, NULL if none */
+    int next;   /* next key of the same prometheus family, -1 if last */
+} status_text_key_t;
+
+/* prometheus metric family: the keys with the same metric name */
+typedef struct {
+    const char *name;
+    const char *type;  /* counter, gauge, histogram or info */
+    double scale;      /* factor from the key value to the metric unit */
+    int first;         /* first key of the family */
+    int last;          /* last key of the family */
+} status_text_family_t;
+
+static apr_array_header_t *status_text_keys = NULL;
+static apr_array_header_t *status_text_families = NULL;
+static const status_text_key_t **status_text_sorted_keys = NULL;
+static int status_text_nb_sorted_keys = 0;
+
+#define STATUS_TEXT_KEY(i) (&APR_ARRAY_IDX(status_text_keys, i, status_text_key_t))
+#define STATUS_TEXT_FAMILY(i) (&APR_ARRAY_IDX(status_text_families, i, status_text_family_t))
+
+/* values of a request used to print the keys */
+typedef struct {
+    request_rec *r;
+    const status_text_snapshot_t *snap; /* NULL if no key needs it */
+    apr_time_t nowtime;
+    apr_interval_time_t up_time;
+    int max_daemons;
+    ap_generation_t generation;
+#ifdef HAVE_TIMES
+    float tick;
+#endif
+    status_text_buf_t *out;
+    int format;   /* STATUS_TEXT_FORMAT_* */
+    int listing;  /* printing the full text output */
+    apr_array_header_t *names; /* names of the keys= list, NULL for all */
+    const apr_uint64_t *delta_old; /* values of the since= snapshot, NULL to print all */
+    apr_uint64_t *delta_new;       /* values of the snapshot published, NULL if none */
+    char *selected; /* keys of the keys= list, by index in status_text_keys */
+} status_text_ctx_t;
+
+static void status_text_add_key(apr_pool_t *p, const char *name, int id, int type, int flags,
+                                int needs, int arg, int arg2)
+{
+    status_text_key_t *key = apr_array_push(status_text_keys);
+
+    key->name = name;
+    key->list_name = NULL;
+    key->id = id;
+    key->type = type;
+    key->flags = flags;
+    key->needs = needs;
+    key->arg = arg;
+    key->arg2 = arg2;
+    key->family = -1;
+    key->labels = NULL;
+    key->next = -1;
+}
+
+static int status_text_key_cmp(const void *a, const void *b)
+{
+    return strcasecmp((*(const status_text_key_t * const *)a)->name,
+                      (*(const status_text_key_t * const *)b)->name);
+}
+
+static int status_text_key_search(const void *name, const void *key)
+{
+    return strcasecmp((const char *)name, (*(const status_text_key_t * const *)key)->name);
+}
+
+/* prometheus metric name of a key name: ApacheTotalAccesses ->
+ * apache_total_accesses, ApacheCPUUsage.User -> apache_cpu_usage_user */
+static const char *status_text_prometheus_name(apr_pool_t *p, const char *name)
+{
+    char *metric = apr_palloc(p, 2 * strlen(name) + 1);
+    char *m = metric;
+    const char *c;
+
+    for (c = name; *c; ++c)
+    {
+      if (!apr_isalnum(*c))
+      {
+        if (m > metric && m[-1] != '_') *m++ = '_';
+        continue;
+      }
+      if (apr_isupper(*c) && c > name && m[-1] != '_' &&
+          (apr_islower(c[-1]) || apr_isdigit(c[-1]) || (apr_isupper(c[-1]) && apr_islower(c[1]))))
+        *m++ = '_';
+      *m++ = apr_tolower(*c);
+    }
+    *m = '\0';
+    return metric;
+}
+
+/* add a key to a prometheus metric family, created at its first key */
+static void status_text_prometheus_family(apr_pool_t *p, int idx, const char *name,
+                                          const char *type, double scale, const char *labels)
+{
+    status_text_family_t *family;
+    int f;
+
+    for (f = 0; f < status_text_families->nelts; ++f)
+      if (strcmp(STATUS_TEXT_FAMILY(f)->name, name) == 0) break;
+    if (f == status_text_families->nelts)
+    {
+      family = apr_array_push(status_text_families);
+      family->name = name;
+      family->type = type;
+      family->scale = scale;
+      family->first = idx;
+    }
+    else
+    {
+      family = STATUS_TEXT_FAMILY(f);
+      STATUS_TEXT_KEY(family->last)->next = idx;
+    }
+    family->last = idx;
+    STATUS_TEXT_KEY(idx)->family = f;
+    STATUS_TEXT_KEY(idx)->labels = labels;
+}
+
+/* prometheus metric families of the keys: the values of a key family are
+ * labels of a single metric (status code, window, quantile), the response
+ * times are in seconds, the response time ranges are a real cumulative
+ * histogram, the strings are labels of apache_info */
+static void status_text_init_prometheus(apr_pool_t *p)
+{
+    status_text_key_t *key;
+    const char *suffix;
+    int i;
+
+    status_text_families = apr_array_make(p, 64, sizeof(status_text_family_t));
+
+    for (i = 0; i < status_text_keys->nelts; ++i)
+    {
+      key = STATUS_TEXT_KEY(i);
+      if (key->flags & (STATUS_TEXT_KEY_QUERY_ONLY|STATUS_TEXT_KEY_ALIAS)) continue;
+
+      switch (key->id)
+      {
+        case STATUS_TEXT_KEY_LISTEN:
+        case STATUS_TEXT_KEY_HISTOGRAM:
+          break;
+        case STATUS_TEXT_KEY_CODE_REQS:
+        case STATUS_TEXT_KEY_CODE_BYTES:
+          suffix = key->name + (key->id == STATUS_TEXT_KEY_CODE_REQS ? 15 : 16);
+          /* the codes, the other codes of the classes and the unknown codes
+           * count every request once, the classes apart, the historical
+           * classes without some codes are not exported */
+          if ((apr_isdigit(suffix[1]) && apr_isdigit(suffix[2])) || suffix[3] == '_' || strcmp(suffix, "xxx") == 0)
+            status_text_prometheus_family(p, i, key->id == STATUS_TEXT_KEY_CODE_REQS ?
+                                          "apache_requests_total" : "apache_bytes_total",
+                                          "counter", 1.0, apr_psprintf(p, "code=\"%s\"", suffix));
+          else if (strcmp(suffix + 1, "xx") == 0)
+            status_text_prometheus_family(p, i, key->id == STATUS_TEXT_KEY_CODE_REQS ?
+                                          "apache_requests_class_total" : "apache_bytes_class_total",
+                                          "counter", 1.0, apr_psprintf(p, "class=\"%s\"", suffix));
+          break;
+        case STATUS_TEXT_KEY_LATENCY:
+          /* all the ranges are printed with the first one */
+          if (key->arg == 0)
+            status_text_prometheus_family(p, i, "apache_request_duration_seconds", "histogram",
+                                          1.0 / APR_USEC_PER_SEC, NULL);
+          break;
+        case STATUS_TEXT_KEY_AVG_RESPONSE_TIME:
+          status_text_prometheus_family(p, i, "apache_response_time_avg_seconds", "gauge",
+                                        1.0 / APR_USEC_PER_SEC,
+                                        apr_psprintf(p, "window=\"%dm\"", status_text_ewma_minutes[key->arg]));
+          break;
+        case STATUS_TEXT_KEY_REQS_PER_SEC:
+          status_text_prometheus_family(p, i, "apache_requests_per_second", "gauge", 1.0,
+                                        apr_psprintf(p, "window=\"%dm\"", status_text_ewma_minutes[key->arg]));
+          break;
+        case STATUS_TEXT_KEY_BYTES_PER_SEC:
+          status_text_prometheus_family(p, i, "apache_bytes_per_second", "gauge", 1.0,
+                                        apr_psprintf(p, "window=\"%dm\"", status_text_ewma_minutes[key->arg]));
+          break;
+        case STATUS_TEXT_KEY_PERCENTIL:
+          status_text_prometheus_family(p, i, "apache_response_time_seconds", "gauge",
+                                        1.0 / APR_USEC_PER_SEC,
+                                        apr_psprintf(p, "window=\"%s\",quantile=\"%g\"",
+                                                     status_text_window_names[key->arg],
+                                                     status_text_percentil_permille[key->arg2] / 1000.0));
+          break;
+        case STATUS_TEXT_KEY_MAX_RESPONSE_TIME:
+          status_text_prometheus_family(p, i, "apache_response_time_max_seconds", "gauge",
+                                        1.0 / APR_USEC_PER_SEC, NULL);
+          break;
+        case STATUS_TEXT_KEY_SERIES:
+          /* prometheus keeps the time series itself */
+          if (key->arg == 0)
+            status_text_prometheus_family(p, i, status_text_prometheus_name(p, key->name), "gauge", 1.0, NULL);
+          break;
+        default:
+          if (key->type == STATUS_TEXT_TYPE_STRING)
+            status_text_prometheus_family(p, i, "apache_info", "info", 1.0,
+                                          status_text_prometheus_name(p, key->name));
+          else
+            status_text_prometheus_family(p, i, status_text_prometheus_name(p, key->name),
+                                          key->type == STATUS_TEXT_TYPE_COUNTER ? "counter" : "gauge",
+                                          1.0, NULL);
+          break;
+      }
+    }
+}
+
+/* build the keys list and its sorted index, after the static values */
+static void status_text_init_keys(apr_pool_t *p)
+{
+    static const struct {
+        const char *name;
+        int id;
+        int type;
+        int needs;
+    } fixed_head[] = {
+        { "ModuleVersion", STATUS_TEXT_KEY_MODULE_VERSION, STATUS_TEXT_TYPE_STRING, 0 },
+        { "ApacheServerRoot", STATUS_TEXT_KEY_SERVER_ROOT, STATUS_TEXT_TYPE_STRING, 0 },
+        { "ApacheServerDocumentRoot", STATUS_TEXT_KEY_DOCUMENT_ROOT, STATUS_TEXT_TYPE_STRING, 0 },
+        { "ApacheServerConfigFile", STATUS_TEXT_KEY_CONFIG_FILE, STATUS_TEXT_TYPE_STRING, 0 },
+        { "ApacheServerName", STATUS_TEXT_KEY_SERVER_NAME, STATUS_TEXT_TYPE_STRING, 0 },
+        { "ApacheServerPort", STATUS_TEXT_KEY_SERVER_PORT, STATUS_TEXT_TYPE_GAUGE, 0 },
+        { NULL, 0, 0, 0 }
+    }, fixed_static[] = {
+        { "ApacheServerVersion", STATUS_TEXT_KEY_SERVER_VERSION, STATUS_TEXT_TYPE_STRING, 0 },
+        { "ApacheServerBuilt", STATUS_TEXT_KEY_SERVER_BUILT, STATUS_TEXT_TYPE_STRING, 0 },
+        { "ApacheAprVersion", STATUS_TEXT_KEY_APR_VERSION, STATUS_TEXT_TYPE_STRING, 0 },
+        { "ApacheAprBuildVersion", STATUS_TEXT_KEY_APR_BUILD_VERSION, STATUS_TEXT_TYPE_STRING, 0 },
+        { "ApacheApuVersion", STATUS_TEXT_KEY_APU_VERSION, STATUS_TEXT_TYPE_STRING, 0 },
+        { "ApacheApuBuildVersion", STATUS_TEXT_KEY_APU_BUILD_VERSION, STATUS_TEXT_TYPE_STRING, 0 },
+        { "ApacheServerMPM", STATUS_TEXT_KEY_MPM, STATUS_TEXT_TYPE_STRING, 0 },
+        { "ApacheThreaded", STATUS_TEXT_KEY_THREADED, STATUS_TEXT_TYPE_STRING, 0 },
+        { "ApacheForked", STATUS_TEXT_KEY_FORKED, STATUS_TEXT_TYPE_STRING, 0 },
+        { "ApacheServerArchitecture", STATUS_TEXT_KEY_ARCHITECTURE, STATUS_TEXT_TYPE_GAUGE, 0 },
+        { "ApacheTimeout", STATUS_TEXT_KEY_TIMEOUT, STATUS_TEXT_TYPE_GAUGE, 0 },
+        { "ApacheKeepAliveTimeout", STATUS_TEXT_KEY_KEEPALIVE_TIMEOUT, STATUS_TEXT_TYPE_GAUGE, 0 },
+        { "ApacheParentServerGeneration", STATUS_TEXT_KEY_GENERATION, STATUS_TEXT_TYPE_GAUGE, 0 },
+        { "ApacheCurrentTime", STATUS_TEXT_KEY_CURRENT_TIME, STATUS_TEXT_TYPE_GAUGE, 0 },
+        { "ApacheRestartTime", STATUS_TEXT_KEY_RESTART_TIME, STATUS_TEXT_TYPE_GAUGE, 0 },
+        { "ApacheServerUptime", STATUS_TEXT_KEY_UPTIME, STATUS_TEXT_TYPE_COUNTER, 0 },
+        { NULL, 0, 0, 0 }
+    }, fixed_stats[] = {
+        { "Apache_Max_ResponseTime", STATUS_TEXT_KEY_MAX_RESPONSE_TIME, STATUS_TEXT_TYPE_GAUGE, STATUS_TEXT_NEED_SLOTS },
+        { "Apache_ResponseTime_Histogram", STATUS_TEXT_KEY_HISTOGRAM, STATUS_TEXT_TYPE_HISTOGRAM, STATUS_TEXT_NEED_SLOTS },
+        { "Apache_Snapshot_Retries", STATUS_TEXT_KEY_SNAPSHOT_RETRIES, STATUS_TEXT_TYPE_GAUGE, STATUS_TEXT_NEED_SLOTS },
+        { "Apache_Series_Seconds", STATUS_TEXT_KEY_SERIES_SECONDS, STATUS_TEXT_TYPE_GAUGE, 0 },
+        { NULL, 0, 0, 0 }
+    }, fixed_tail[] = {
+        { "ApacheTotalAccesses", STATUS_TEXT_KEY_TOTAL_ACCESSES, STATUS_TEXT_TYPE_COUNTER, STATUS_TEXT_NEED_WORKERS },
+        { "ApacheTotalKBytes", STATUS_TEXT_KEY_TOTAL_KBYTES, STATUS_TEXT_TYPE_COUNTER, STATUS_TEXT_NEED_WORKERS },
+        { "ApacheThreadLimit", STATUS_TEXT_KEY_THREAD_LIMIT, STATUS_TEXT_TYPE_GAUGE, 0 },
+        { "ApacheServerLimit", STATUS_TEXT_KEY_SERVER_LIMIT, STATUS_TEXT_TYPE_GAUGE, 0 },
+        { "ApacheMaxWorker", STATUS_TEXT_KEY_MAX_WORKER, STATUS_TEXT_TYPE_GAUGE, 0 },
+        { "ApacheBusyWorkers", STATUS_TEXT_KEY_BUSY_WORKERS, STATUS_TEXT_TYPE_GAUGE, STATUS_TEXT_NEED_WORKERS },
+        { "ApacheIdleWorkers", STATUS_TEXT_KEY_IDLE_WORKERS, STATUS_TEXT_TYPE_GAUGE, STATUS_TEXT_NEED_WORKERS },
+#ifdef HAVE_TIMES
+        { "ApacheCPUUsage.User", STATUS_TEXT_KEY_CPU_USER, STATUS_TEXT_TYPE_COUNTER, STATUS_TEXT_NEED_CPU },
+        { "ApacheCPUUsage.System", STATUS_TEXT_KEY_CPU_SYSTEM, STATUS_TEXT_TYPE_COUNTER, STATUS_TEXT_NEED_CPU },
+        { "ApacheChildCPUUsage.User", STATUS_TEXT_KEY_CHILD_CPU_USER, STATUS_TEXT_TYPE_COUNTER, STATUS_TEXT_NEED_CPU },
+        { "ApacheChildCPUUsage.System", STATUS_TEXT_KEY_CHILD_CPU_SYSTEM, STATUS_TEXT_TYPE_COUNTER, STATUS_TEXT_NEED_CPU },
+#endif
+        { NULL, 0, 0, 0 }
+    };
+    const status_text_key_t **sorted;
+    int i, k, bytes;
+
+    status_text_keys = apr_array_make(p, 256, sizeof(status_text_key_t));
+
+#define STATUS_TEXT_ADD_FIXED(list) \
+    for (i = 0; list[i].name; ++i) \
+      status_text_add_key(p, list[i].name, list[i].id, list[i].type, 0, list[i].needs, 0, 0)
+
+    STATUS_TEXT_ADD_FIXED(fixed_head);
+    status_text_add_key(p, "ApacheListen/count", STATUS_TEXT_KEY_LISTEN_COUNT, STATUS_TEXT_TYPE_GAUGE,
+                        STATUS_TEXT_KEY_QUERY_ONLY, 0, 0, 0);
+    for (i = 0; i < status_text_static.nb_listen; ++i)
+    {
+      status_text_add_key(p, apr_psprintf(p, "ApacheListen/%d", i), STATUS_TEXT_KEY_LISTEN,
+                          STATUS_TEXT_TYPE_STRING, STATUS_TEXT_KEY_OPTIONAL, 0, i, 0);
+      STATUS_TEXT_KEY(status_text_keys->nelts - 1)->list_name = apr_psprintf(p, "ApacheListen[%d]", i);
+    }
+    STATUS_TEXT_ADD_FIXED(fixed_static);
+
+    /* number of requests and bytes per status code: the historical keys,
+     * the classes, then every other status code that occured */
+    for (bytes = 0; bytes < 2; ++bytes)
+    {
+      const char *prefix = bytes ? "Apache_NB_Bytes_" : "Apache_NB_Reqs_";
+      int id = bytes ? STATUS_TEXT_KEY_CODE_BYTES : STATUS_TEXT_KEY_CODE_REQS;
+
+      for (i = 0; status_text_legacy_codes[i]; ++i)
+        status_text_add_key(p, apr_pstrcat(p, prefix, status_text_legacy_codes[i], NULL),
+                            id, STATUS_TEXT_TYPE_COUNTER, 0, STATUS_TEXT_NEED_SLOTS, 0, 0);
+      for (i = 1; i < STATUS_TEXT_FIRST_CODE; ++i)
+      {
+        status_text_add_key(p, apr_psprintf(p, "%s%dxx", prefix, i), id, STATUS_TEXT_TYPE_COUNTER,
+                            0, STATUS_TEXT_NEED_SLOTS, 0, 0);
+        status_text_add_key(p, apr_psprintf(p, "%s%dxx_Other", prefix, i), id, STATUS_TEXT_TYPE_COUNTER,
+                            STATUS_TEXT_KEY_OPTIONAL, STATUS_TEXT_NEED_SLOTS, i, 0);
+      }
+      for (k = STATUS_TEXT_FIRST_CODE; k < STATUS_TEXT_NB_CODES; ++k)
+      {
+        const char *code = apr_psprintf(p, "%d", status_text_codes[k-STATUS_TEXT_FIRST_CODE]);
+        for (i = 0; status_text_legacy_codes[i]; ++i)
+          if (strcmp(code, status_text_legacy_codes[i]) == 0) break;
+        if (status_text_legacy_codes[i]) continue;
+        status_text_add_key(p, apr_pstrcat(p, prefix, code, NULL), id, STATUS_TEXT_TYPE_COUNTER,
+                            STATUS_TEXT_KEY_OPTIONAL, STATUS_TEXT_NEED_SLOTS, k, 0);
+      }
+    }
+
+    /* number of request per response times range */
+    for (k = 0; k < status_text_nb_latency_buckets; ++k)
+      status_text_add_key(p, apr_pstrcat(p, "Apache_NB_Reqs_", status_text_latency_keys[k], NULL),
+                          STATUS_TEXT_KEY_LATENCY, STATUS_TEXT_TYPE_COUNTER, 0, STATUS_TEXT_NEED_SLOTS, k, 0);
+
+    /* moving averages, Apache_Avg_ResponseTime is the first window */
+    status_text_add_key(p, "Apache_Avg_ResponseTime", STATUS_TEXT_KEY_AVG_RESPONSE_TIME,
+                        STATUS_TEXT_TYPE_GAUGE, STATUS_TEXT_KEY_ALIAS, STATUS_TEXT_NEED_SLOTS, 0, 0);
+    for (k = 0; k < STATUS_TEXT_EWMA_WINDOWS; ++k)
+    {
+      status_text_add_key(p, apr_psprintf(p, "Apache_Avg_ResponseTime_%dm", status_text_ewma_minutes[k]),
+                          STATUS_TEXT_KEY_AVG_RESPONSE_TIME, STATUS_TEXT_TYPE_GAUGE, 0,
+                          STATUS_TEXT_NEED_SLOTS, k, 0);
+      status_text_add_key(p, apr_psprintf(p, "Apache_Reqs_Per_Sec_%dm", status_text_ewma_minutes[k]),
+                          STATUS_TEXT_KEY_REQS_PER_SEC, STATUS_TEXT_TYPE_GAUGE, 0,
+                          STATUS_TEXT_NEED_SLOTS, k, 0);
+      status_text_add_key(p, apr_psprintf(p, "Apache_Bytes_Per_Sec_%dm", status_text_ewma_minutes[k]),
+                          STATUS_TEXT_KEY_BYTES_PER_SEC, STATUS_TEXT_TYPE_GAUGE, 0,
+                          STATUS_TEXT_NEED_SLOTS, k, 0);
+    }
+
+    /* sliding windows percentils, without suffix for the default window */
+    for (i = 0; i < STATUS_TEXT_NB_PERCENTILS; ++i)
+      status_text_add_key(p, status_text_percentil_keys[i], STATUS_TEXT_KEY_PERCENTIL,
+                          STATUS_TEXT_TYPE_GAUGE, STATUS_TEXT_KEY_ALIAS,
+                          STATUS_TEXT_NEED_SLOTS|STATUS_TEXT_NEED_PERCENTILS, STATUS_TEXT_DEFAULT_WINDOW, i);
+    for (k = 0; k < STATUS_TEXT_WINDOWS; ++k)
+      for (i = 0; i < STATUS_TEXT_NB_PERCENTILS; ++i)
+        status_text_add_key(p, apr_pstrcat(p, status_text_percentil_keys[i], "_",
+                                           status_text_window_names[k], NULL),
+                            STATUS_TEXT_KEY_PERCENTIL, STATUS_TEXT_TYPE_GAUGE, 0,
+                            STATUS_TEXT_NEED_SLOTS|STATUS_TEXT_NEED_PERCENTILS, k, i);
+
+    STATUS_TEXT_ADD_FIXED(fixed_stats);
+
+    /* per second time series */
+    for (k = 0; status_text_series_keys[k]; ++k)
+      status_text_add_key(p, status_text_series_keys[k], STATUS_TEXT_KEY_SERIES,
+                          k ? STATUS_TEXT_TYPE_SERIES : STATUS_TEXT_TYPE_GAUGE, 0,
+                          STATUS_TEXT_NEED_SLOTS|STATUS_TEXT_NEED_SERIES, k, 0);
+
+    STATUS_TEXT_ADD_FIXED(fixed_tail);
+#ifdef HAVE_TIMES
+    status_text_add_key(p, "ApacheCPULoad", STATUS_TEXT_KEY_CPU_LOAD, STATUS_TEXT_TYPE_GAUGE,
+                        STATUS_TEXT_KEY_OPTIONAL, STATUS_TEXT_NEED_CPU, 0, 0);
+#endif
+#undef STATUS_TEXT_ADD_FIXED
+
+    /* sorted index, the first of the keys with the same name is kept */
+    sorted = apr_palloc(p, status_text_keys->nelts * sizeof(status_text_key_t *));
+    for (i = 0; i < status_text_keys->nelts; ++i)
+      sorted[i] = STATUS_TEXT_KEY(i);
+    qsort(sorted, status_text_keys->nelts, sizeof(status_text_key_t *), status_text_key_cmp);
+    for (i = 0, k = 0; i < status_text_keys->nelts; ++i)
+    {
+      if (k > 0 && strcasecmp(sorted[k-1]->name, sorted[i]->name) == 0)
+      {
+        if (sorted[i] < sorted[k-1]) sorted[k-1] = sorted[i];
+        continue;
+      }
+      sorted[k++] = sorted[i];
+    }
+    status_text_sorted_keys = sorted;
+    status_text_nb_sorted_keys = k;
+
+    status_text_init_prometheus(p);
+}
+
+/* get a key by its name (case insensitive), NULL if unknown */
+static const status_text_key_t *status_text_find_key(const char *name)
+{
+    const status_text_key_t **key;
+
+    key = bsearch(name, status_text_sorted_keys, status_text_nb_sorted_keys,
+                  sizeof(status_text_key_t *), status_text_key_search);
+    return key ? *key : NULL;
+}
+
+/* is an optional key printed: active listener, status codes that occured,
+ * cpu load when known */
+static int status_text_key_present(status_text_ctx_t *ctx, const status_text_key_t *key)
+{
+    const status_text_snapshot_t *snap = ctx->snap;
+
+    if (!(key->flags & STATUS_TEXT_KEY_OPTIONAL)) return 1;
+    switch (key->id)
+    {
+      case STATUS_TEXT_KEY_LISTEN:
+        return status_text_static.listen[key->arg] != NULL;
+      case STATUS_TEXT_KEY_CODE_REQS:
+      case STATUS_TEXT_KEY_CODE_BYTES:
+        /* other codes of a class when not empty, codes that occured */
+        if (key->arg < STATUS_TEXT_FIRST_CODE && key->id == STATUS_TEXT_KEY_CODE_BYTES)
+          return snap->codes[key->arg].bytes != 0;
+        return snap->codes[key->arg].reqs != 0;
+#ifdef HAVE_TIMES
+      case STATUS_TEXT_KEY_CPU_LOAD:
+        return snap->ts || snap->tu || snap->tcu || snap->tcs;
+#endif
+    }
+    return 1;
+}
+
+/* print a string value, quoted and escaped in json */
+static void status_text_print_string(status_text_ctx_t *ctx, const char *value)
+{
+    status_text_buf_t *out = ctx->out;
+    const char *c;
+
+    if (ctx->format != STATUS_TEXT_FORMAT_JSON)
+    {
+      status_text_buf_puts(out, value);
+      return;
+    }
+    status_text_buf_putc(out, '"');
+    for (c = value; *c; ++c)
+    {
+      if (*c == '"' || *c == '\\') status_text_buf_putc(out, '\\');
+      if ((unsigned char)*c < 0x20) status_text_buf_printf(out, "\\u%04x", (unsigned char)*c);
+      else status_text_buf_putc(out, *c);
+    }
+    status_text_buf_putc(out, '"');
+}
+
+/* get the value of a string key, NULL if it has none */
+static const char *status_text_key_string(status_text_ctx_t *ctx, const status_text_key_t *key)
+{
+    switch (key->id)
+    {
+      case STATUS_TEXT_KEY_MODULE_VERSION:
+        return MOD_VERSION;
+      case STATUS_TEXT_KEY_SERVER_ROOT:
+        return ap_server_root;
+      case STATUS_TEXT_KEY_DOCUMENT_ROOT:
+        return ap_document_root(ctx->r);
+      case STATUS_TEXT_KEY_CONFIG_FILE:
+        return status_text_static.config_file;
+      case STATUS_TEXT_KEY_SERVER_NAME:
+        return ap_get_server_name(ctx->r);
+      case STATUS_TEXT_KEY_LISTEN:
+        return status_text_static.listen[key->arg];
+      case STATUS_TEXT_KEY_SERVER_VERSION:
+        return status_text_static.server_version;
+      case STATUS_TEXT_KEY_SERVER_BUILT:
+        return status_text_static.server_built;
+      case STATUS_TEXT_KEY_APR_VERSION:
+        return status_text_static.apr_version;
+      case STATUS_TEXT_KEY_APR_BUILD_VERSION:
+        return APR_VERSION_STRING;
+      case STATUS_TEXT_KEY_APU_VERSION:
+        return status_text_static.apu_version;
+      case STATUS_TEXT_KEY_APU_BUILD_VERSION:
+        return APU_VERSION_STRING;
+      case STATUS_TEXT_KEY_MPM:
+        return status_text_static.mpm;
+      case STATUS_TEXT_KEY_THREADED:
+        return threaded ? "yes" : "no";
+      case STATUS_TEXT_KEY_FORKED:
+        return forked ? "yes" : "no";
+    }
+    return NULL;
+}
+
+/* print the value of a key, without end of line */
+static void status_text_print_key(status_text_ctx_t *ctx, const status_text_key_t *key)
+{
+    status_text_buf_t *out = ctx->out;
+    request_rec *r = ctx->r;
+    const status_text_snapshot_t *snap = ctx->snap;
+    int json = ctx->format == STATUS_TEXT_FORMAT_JSON;
+    apr_uint64_t code_value = 0;
+    int i, j;
+
+    /* strings, null in json for the inactive listeners */
+    if (key->type == STATUS_TEXT_TYPE_STRING)
+    {
+      const char *value = status_text_key_string(ctx, key);
+      if (value) status_text_print_string(ctx, value);
+      else if (json) status_text_buf_puts(out, "null");
+      return;
+    }
+
+    switch (key->id)
+    {
+      case STATUS_TEXT_KEY_SERVER_PORT:
+        status_text_buf_i64(out, ap_get_server_port(r));
+        break;
+      case STATUS_TEXT_KEY_LISTEN_COUNT:
+        status_text_buf_i64(out, status_text_static.nb_listen);
+        break;
+      case STATUS_TEXT_KEY_ARCHITECTURE:
+        status_text_buf_i64(out, 8 * (long) sizeof(void *));
+        if (ctx->listing) status_text_buf_puts(out, "-bit");
+        break;
+      case STATUS_TEXT_KEY_TIMEOUT:
+        status_text_buf_i64(out, (int) (apr_time_sec(r->server->timeout)));
+        break;
+      case STATUS_TEXT_KEY_KEEPALIVE_TIMEOUT:
+        status_text_buf_i64(out, (int) (apr_time_sec(r->server->keep_alive_timeout)));
+        break;
+      case STATUS_TEXT_KEY_GENERATION:
+        status_text_buf_i64(out, (int)ctx->generation);
+        break;
+      case STATUS_TEXT_KEY_CURRENT_TIME:
+        status_text_buf_i64(out, ctx->nowtime);
+        break;
+      case STATUS_TEXT_KEY_RESTART_TIME:
+        status_text_buf_i64(out, ap_scoreboard_image->global->restart_time);
+        break;
+      case STATUS_TEXT_KEY_UPTIME:
+        status_text_buf_i64(out, (long) (ctx->up_time));
+        break;
+      case STATUS_TEXT_KEY_CODE_REQS:
+        status_text_code_value(snap->codes, key->name + 15, 0, &code_value);
+        status_text_buf_u64(out, code_value);
+        break;
+      case STATUS_TEXT_KEY_CODE_BYTES:
+        status_text_code_value(snap->codes, key->name + 16, 1, &code_value);
+        status_text_buf_u64(out, code_value);
+        break;
+      case STATUS_TEXT_KEY_LATENCY:
+        status_text_buf_u64(out, snap->nb_reqs_latency[key->arg]);
+        break;
+      case STATUS_TEXT_KEY_AVG_RESPONSE_TIME:
+        status_text_buf_fixed3(out, STATUS_TEXT_MSEC(STATUS_TEXT_EWMA_TIME(snap->ewma[key->arg])));
+        break;
+      case STATUS_TEXT_KEY_REQS_PER_SEC:
+        status_text_buf_fixed3(out, snap->ewma[key->arg].reqs/(60.0*status_text_ewma_minutes[key->arg]));
+        break;
+      case STATUS_TEXT_KEY_BYTES_PER_SEC:
+        status_text_buf_fixed3(out, snap->ewma[key->arg].bytes/(60.0*status_text_ewma_minutes[key->arg]));
+        break;
+      case STATUS_TEXT_KEY_PERCENTIL:
+        status_text_buf_fixed3(out, STATUS_TEXT_MSEC(snap->percentil[key->arg][key->arg2]));
+        break;
+      case STATUS_TEXT_KEY_MAX_RESPONSE_TIME:
+        status_text_buf_fixed3(out, STATUS_TEXT_MSEC(snap->max_response_time));
+        break;
+      case STATUS_TEXT_KEY_HISTOGRAM:
+        /* non empty histogram buckets as upper_bound:count, in microseconds,
+         * an object of upper_bound: count in json */
+        if (json) status_text_buf_putc(out, '{');
+        for (i = 0, j = 0; i < STATUS_TEXT_HIST_BUCKETS; ++i)
+        {
+          if (snap->hist[i]==0) continue;
+          if (j++) status_text_buf_putc(out, ',');
+          if (json) status_text_buf_putc(out, '"');
+          status_text_buf_i64(out, status_text_hist_upper(i));
+          status_text_buf_puts(out, json ? "\":" : ":");
+          status_text_buf_u64(out, snap->hist[i]);
+        }
+        if (json) status_text_buf_putc(out, '}');
+        break;
+      case STATUS_TEXT_KEY_SNAPSHOT_RETRIES:
+        status_text_buf_u64(out, snap->read_retries);
+        break;
+      case STATUS_TEXT_KEY_SERIES_SECONDS:
+        status_text_buf_i64(out, status_text_series_seconds);
+        break;
+      case STATUS_TEXT_KEY_SERIES:
+        if (json && key->type == STATUS_TEXT_TYPE_SERIES) status_text_buf_putc(out, '[');
+        status_text_print_series(out, key->arg, snap->series, status_text_series_seconds);
+        if (json && key->type == STATUS_TEXT_TYPE_SERIES) status_text_buf_putc(out, ']');
+        break;
+      case STATUS_TEXT_KEY_TOTAL_ACCESSES:
+        status_text_buf_u64(out, snap->count);
+        break;
+      case STATUS_TEXT_KEY_TOTAL_KBYTES:
+        status_text_buf_u64(out, snap->kbcount);
+        break;
+      case STATUS_TEXT_KEY_THREAD_LIMIT:
+        status_text_buf_u64(out, thread_limit);
+        break;
+      case STATUS_TEXT_KEY_SERVER_LIMIT:
+        status_text_buf_u64(out, server_limit);
+        break;
+      case STATUS_TEXT_KEY_MAX_WORKER:
+        status_text_buf_i64(out, ctx->max_daemons);
+        break;
+      case STATUS_TEXT_KEY_BUSY_WORKERS:
+        status_text_buf_i64(out, snap->busy);
+        break;
+      case STATUS_TEXT_KEY_IDLE_WORKERS:
+        status_text_buf_i64(out, snap->ready);
+        break;
+#ifdef HAVE_TIMES
+      case STATUS_TEXT_KEY_CPU_USER:
+        status_text_buf_printf(out, "%g", snap->tu / ctx->tick);
+        break;
+      case STATUS_TEXT_KEY_CPU_SYSTEM:
+        status_text_buf_printf(out, "%g", snap->ts / ctx->tick);
+        break;
+      case STATUS_TEXT_KEY_CHILD_CPU_USER:
+        status_text_buf_printf(out, "%g", snap->tcu / ctx->tick);
+        break;
+      case STATUS_TEXT_KEY_CHILD_CPU_SYSTEM:
+        status_text_buf_printf(out, "%g", snap->tcs / ctx->tick);
+        break;
+      case STATUS_TEXT_KEY_CPU_LOAD:
+        if (snap->ts || snap->tu || snap->tcu || snap->tcs)
+          status_text_buf_printf(out, "%g", (snap->tu + snap->ts + snap->tcu + snap->tcs) / ctx->tick / ctx->up_time * 100.);
+        else
+          status_text_buf_puts(out, json ? "null" : "na");
+        break;
+#endif
+    }
+}
+
+/* get the numeric value of a key, return 0 if it has none */
+static int status_text_key_number(status_text_ctx_t *ctx, const status_text_key_t *key, double *value)
+{
+    const status_text_snapshot_t *snap = ctx->snap;
+    apr_uint64_t code_value = 0;
+    int k;
+
+    switch (key->id)
+    {
+      case STATUS_TEXT_KEY_SERVER_PORT:
+        *value = ap_get_server_port(ctx->r);
+        return 1;
+      case STATUS_TEXT_KEY_LISTEN_COUNT:
+        *value = status_text_static.nb_listen;
+        return 1;
+      case STATUS_TEXT_KEY_ARCHITECTURE:
+        *value = 8 * sizeof(void *);
+        return 1;
+      case STATUS_TEXT_KEY_TIMEOUT:
+        *value = apr_time_sec(ctx->r->server->timeout);
+        return 1;
+      case STATUS_TEXT_KEY_KEEPALIVE_TIMEOUT:
+        *value = apr_time_sec(ctx->r->server->keep_alive_timeout);
+        return 1;
+      case STATUS_TEXT_KEY_GENERATION:
+        *value = ctx->generation;
+        return 1;
+      case STATUS_TEXT_KEY_CURRENT_TIME:
+        *value = ctx->nowtime;
+        return 1;
+      case STATUS_TEXT_KEY_RESTART_TIME:
+        *value = ap_scoreboard_image->global->restart_time;
+        return 1;
+      case STATUS_TEXT_KEY_UPTIME:
+        *value = ctx->up_time;
+        return 1;
+      case STATUS_TEXT_KEY_CODE_REQS:
+      case STATUS_TEXT_KEY_CODE_BYTES:
+        if (key->id == STATUS_TEXT_KEY_CODE_REQS)
+          status_text_code_value(snap->codes, key->name + 15, 0, &code_value);
+        else
+          status_text_code_value(snap->codes, key->name + 16, 1, &code_value);
+        *value = code_value;
+        return 1;
+      case STATUS_TEXT_KEY_LATENCY:
+        *value = snap->nb_reqs_latency[key->arg];
+        return 1;
+      case STATUS_TEXT_KEY_AVG_RESPONSE_TIME:
+        *value = STATUS_TEXT_EWMA_TIME(snap->ewma[key->arg]);
+        return 1;
+      case STATUS_TEXT_KEY_REQS_PER_SEC:
+        *value = snap->ewma[key->arg].reqs/(60.0*status_text_ewma_minutes[key->arg]);
+        return 1;
+      case STATUS_TEXT_KEY_BYTES_PER_SEC:
+        *value = snap->ewma[key->arg].bytes/(60.0*status_text_ewma_minutes[key->arg]);
+        return 1;
+      case STATUS_TEXT_KEY_PERCENTIL:
+        *value = snap->percentil[key->arg][key->arg2];
+        return 1;
+      case STATUS_TEXT_KEY_MAX_RESPONSE_TIME:
+        *value = snap->max_response_time;
+        return 1;
+      case STATUS_TEXT_KEY_SNAPSHOT_RETRIES:
+        *value = snap->read_retries;
+        return 1;
+      case STATUS_TEXT_KEY_SERIES_SECONDS:
+        *value = status_text_series_seconds;
+        return 1;
+      case STATUS_TEXT_KEY_SERIES:
+        if (key->arg != 0) return 0;
+        *value = 0;
+        for (k = 0; k < status_text_series_seconds; ++k)
+          if (snap->series[k].reqs > *value) *value = snap->series[k].reqs;
+        return 1;
+      case STATUS_TEXT_KEY_TOTAL_ACCESSES:
+        *value = snap->count;
+        return 1;
+      case STATUS_TEXT_KEY_TOTAL_KBYTES:
+        *value = snap->kbcount;
+        return 1;
+      case STATUS_TEXT_KEY_THREAD_LIMIT:
+        *value = thread_limit;
+        return 1;
+      case STATUS_TEXT_KEY_SERVER_LIMIT:
+        *value = server_limit;
+        return 1;
+      case STATUS_TEXT_KEY_MAX_WORKER:
+        *value = ctx->max_daemons;
+        return 1;
+      case STATUS_TEXT_KEY_BUSY_WORKERS:
+        *value = snap->busy;
+        return 1;
+      case STATUS_TEXT_KEY_IDLE_WORKERS:
+        *value = snap->ready;
+        return 1;
+#ifdef HAVE_TIMES
+      case STATUS_TEXT_KEY_CPU_USER:
+        *value = snap->tu / ctx->tick;
+        return 1;
+      case STATUS_TEXT_KEY_CPU_SYSTEM:
+        *value = snap->ts / ctx->tick;
+        return 1;
+      case STATUS_TEXT_KEY_CHILD_CPU_USER:
+        *value = snap->tcu / ctx->tick;
+        return 1;
+      case STATUS_TEXT_KEY_CHILD_CPU_SYSTEM:
+        *value = snap->tcs / ctx->tick;
+        return 1;
+      case STATUS_TEXT_KEY_CPU_LOAD:
+        if (!(snap->ts || snap->tu || snap->tcu || snap->tcs) || ctx->up_time <= 0) return 0;
+        *value = (snap->tu + snap->ts + snap->tcu + snap->tcs) / ctx->tick / ctx->up_time * 100.;
+        return 1;
+#endif
+    }
+    return 0;
+}
+
+/* is a key printed: selected by keys=, or listed in the full output */
+#define STATUS_TEXT_KEY_PRINTED(ctx, idx) ((ctx)->names ? (ctx)->selected[idx] : \
+        !(STATUS_TEXT_KEY(idx)->flags & STATUS_TEXT_KEY_QUERY_ONLY) && \
+        status_text_key_present(ctx, STATUS_TEXT_KEY(idx)))
+
+#define STATUS_TEXT_FNV_INIT APR_UINT64_C(14695981039346656037)
+
+/* FNV-1a hash of n bytes */
+static apr_uint64_t status_text_fnv(apr_uint64_t h, const char *s, apr_size_t n)
+{
+    while (n--)
+    {
+      h ^= (unsigned char)*s++;
+      h *= APR_UINT64_C(1099511628211);
+    }
+    return h;
+}
+
+static APR_INLINE apr_uint64_t status_text_double_bits(double v)
+{
+    apr_uint64_t bits;
+    memcpy(&bits, &v, sizeof(bits));
+    return bits;
+}
+
+static APR_INLINE double status_text_bits_double(apr_uint64_t bits)
+{
+    double v;
+    memcpy(&v, &bits, sizeof(v));
+    return v;
+}
+
+/* value of a key kept in the delta snapshots: the number of the counters
+ * (to see their resets), the hash of the printed value of the others */
+static apr_uint64_t status_text_delta_value(status_text_ctx_t *ctx, const status_text_key_t *key,
+                                            const char *printed, apr_size_t len)
+{
+    double value;
+
+    if (key->type == STATUS_TEXT_TYPE_COUNTER && status_text_key_number(ctx, key, &value))
+      return status_text_double_bits(value);
+    return status_text_fnv(STATUS_TEXT_FNV_INIT, printed, len) | 1;
+}
+
+/* token of a published snapshot: restart time and sequence number */
+static const char *status_text_delta_token(apr_pool_t *p, apr_uint32_t seq)
+{
+    return apr_psprintf(p, "%" APR_TIME_T_FMT ".%u", ap_scoreboard_image->global->restart_time, seq);
+}
+
+/* get a copy of the values of the snapshot of a since= token (key values
+ * then nb_lines worker lines values, NULL if the snapshot has none).
+ * return NULL if it is found, else the reset reason: restart if the server
+ * restarted since, unknown if the snapshot was replaced or the token is
+ * invalid */
+static const char *status_text_delta_load(apr_pool_t *p, const char *token, apr_uint64_t **keys,
+                                          apr_uint64_t **workers, apr_uint32_t *nb_lines)
+{
+    status_text_delta_t *d;
+    apr_time_t restart_time;
+    apr_uint32_t seq, nb;
+    char *end;
+
+    *keys = *workers = NULL;
+    *nb_lines = 0;
+    restart_time = apr_strtoi64(token, &end, 10);
+    if (*end != '.') return "unknown";
+    if (restart_time != ap_scoreboard_image->global->restart_time) return "restart";
+    seq = (apr_uint32_t)strtoul(end + 1, &end, 10);
+    if (*end || seq == 0 || status_text_delta == NULL) return "unknown";
+
+    /* copy the entry, it is valid if its sequence number did not change */
+    d = STATUS_TEXT_DELTA(seq % STATUS_TEXT_DELTA_TOKENS);
+    if (d->seq != seq) return "unknown";
+    STATUS_TEXT_READ_BARRIER();
+    nb = d->nb_lines;
+    if (nb > status_text_delta_lines) nb = status_text_delta_lines;
+    *keys = apr_palloc(p, sizeof(apr_uint64_t) * (status_text_delta_keys + 2 * (apr_size_t)nb));
+    memcpy(*keys, STATUS_TEXT_DELTA_VALUES(d), sizeof(apr_uint64_t) * (status_text_delta_keys + 2 * (apr_size_t)nb));
+    if (d->has_workers) *workers = *keys + status_text_delta_keys;
+    STATUS_TEXT_READ_BARRIER();
+    if (d->seq != seq || d->restart_time != restart_time)
+    {
+      *keys = *workers = NULL;
+      return "unknown";
+    }
+    if (*workers) *nb_lines = nb;
+    return NULL;
+}
+
+/* publish the values of a snapshot (and its nb_lines worker lines values)
+ * under its sequence number, skipped if another handler writes the same
+ * entry */
+static void status_text_delta_publish(apr_uint32_t seq, const apr_uint64_t *values,
+                                      int has_workers, apr_uint32_t nb_lines)
+{
+    status_text_delta_t *d = STATUS_TEXT_DELTA(seq % STATUS_TEXT_DELTA_TOKENS);
+
+    if (apr_atomic_cas32(&d->writing, 1, 0) != 0) return;
+    d->seq = 0;
+    STATUS_TEXT_WRITE_BARRIER();
+    d->restart_time = ap_scoreboard_image->global->restart_time;
+    d->has_workers = has_workers;
+    d->nb_lines = nb_lines;
+    memcpy(STATUS_TEXT_DELTA_VALUES(d), values,
+           sizeof(apr_uint64_t) * (status_text_delta_keys + 2 * (apr_size_t)nb_lines));
+    STATUS_TEXT_WRITE_BARRIER();
+    d->seq = seq;
+    apr_atomic_set32(&d->writing, 0);
+}
+
+/* print the worker lines of a since= snapshot before the line index indx
+ * as removed (the lines of the child of the query only), the snapshot
+ * lines are walked in the order of their index from *pos */
+static void status_text_delta_removed(status_text_buf_t *lines, const apr_uint64_t *workers,
+                                      apr_uint32_t nb_lines, apr_uint32_t *pos,
+                                      apr_uint64_t indx, int child)
+{
+    int i;
+
+    for (; *pos < nb_lines && workers[2 * *pos] < indx; ++*pos)
+    {
+      i = (int)(workers[2 * *pos] / thread_limit);
+      if (child >= 0 && i != child)
+        continue;
+      status_text_buf_puts(lines, "ApacheWorker[");
+      status_text_buf_i64(lines, i);
+      status_text_buf_putc(lines, '-');
+      status_text_buf_i64(lines, (int)(workers[2 * *pos] % thread_limit));
+      status_text_buf_puts(lines, "]: removed\n");
+    }
+}
+
+/* print the keys as "key: value" lines: the keys= list in its order,
+ * or the full output */
+static void status_text_print_text(status_text_ctx_t *ctx)
+{
+    status_text_buf_t *out = ctx->out;
+    const status_text_key_t *key;
+    const char *name;
+    apr_uint64_t value;
+    apr_size_t start;
+    int i;
+
+    if (ctx->names)
+    {
+      for (i = 0; i < ctx->names->nelts; ++i)
+      {
+        name = APR_ARRAY_IDX(ctx->names, i, const char *);
+        key = status_text_find_key(name);
+        if (key == NULL)
+        {
+          status_text_buf_vputs(ctx->out, name, ": Unknown Attribut!\n", NULL);
+          continue;
+        }
+        status_text_buf_vputs(ctx->out, key->name, ": ", NULL);
+        status_text_print_key(ctx, key);
+        status_text_buf_puts(ctx->out, "\n");
+      }
+      return;
+    }
+
+    for (i = 0; i < status_text_keys->nelts; ++i)
+    {
+      if (!STATUS_TEXT_KEY_PRINTED(ctx, i)) continue;
+      key = STATUS_TEXT_KEY(i);
+      if (ctx->delta_old == NULL && ctx->delta_new == NULL)
+      {
+        status_text_buf_vputs(out, key->list_name ? key->list_name : key->name, ": ", NULL);
+        status_text_print_key(ctx, key);
+        status_text_buf_puts(out, "\n");
+        continue;
+      }
+
+      /* delta: the line is dropped if the value did not change */
+      status_text_buf_mark(out);
+      status_text_buf_vputs(out, key->list_name ? key->list_name : key->name, ": ", NULL);
+      start = out->len - out->mark;
+      status_text_print_key(ctx, key);
+      value = status_text_delta_value(ctx, key, out->buf + out->mark + start, out->len - out->mark - start);
+      if (ctx->delta_new) ctx->delta_new[i] = value;
+      if (ctx->delta_old && ctx->delta_old[i] == value)
+      {
+        status_text_buf_rollback(out);
+        continue;
+      }
+      status_text_buf_unmark(out);
+      status_text_buf_puts(out, "\n");
+      if (ctx->delta_old && ctx->delta_old[i] && key->type == STATUS_TEXT_TYPE_COUNTER &&
+          status_text_bits_double(value) < status_text_bits_double(ctx->delta_old[i]))
+        status_text_buf_vputs(out, "Apache_Delta_Reset: ", key->name, "\n", NULL);
+    }
+}
+
+/* print the keys as a json object */
+static void status_text_print_json(status_text_ctx_t *ctx)
+{
+    int i, n = 0;
+
+    status_text_buf_puts(ctx->out, "{");
+    for (i = 0; i < status_text_keys->nelts; ++i)
+    {
+      if (!STATUS_TEXT_KEY_PRINTED(ctx, i)) continue;
+      status_text_buf_vputs(ctx->out, n++ ? ",\n" : "\n", "\"", STATUS_TEXT_KEY(i)->name, "\":", NULL);
+      status_text_print_key(ctx, STATUS_TEXT_KEY(i));
+    }
+    status_text_buf_puts(ctx->out, "\n}\n");
+}
+
+/* print the response time ranges as a prometheus cumulative histogram */
+static void status_text_print_prometheus_histogram(status_text_ctx_t *ctx, const char *name)
+{
+    status_text_buf_t *out = ctx->out;
+    apr_uint64_t cumul = 0;
+    int k;
+
+    for (k = 0; k < status_text_nb_latency_buckets; ++k)
+    {
+      cumul += ctx->snap->nb_reqs_latency[k];
+      if (k < status_text_nb_latency_buckets - 1)
+      {
+        status_text_buf_vputs(out, name, "_bucket{le=\"", NULL);
+        status_text_buf_printf(out, "%g", (double)status_text_latency_bounds[k] / APR_USEC_PER_SEC);
+        status_text_buf_puts(out, "\"} ");
+        status_text_buf_u64(out, cumul);
+        status_text_buf_putc(out, '\n');
+      }
+    }
+    status_text_buf_vputs(out, name, "_bucket{le=\"+Inf\"} ", NULL);
+    status_text_buf_u64(out, cumul);
+    status_text_buf_vputs(out, "\n", name, "_sum ", NULL);
+    status_text_buf_printf(out, "%.6f", (double)ctx->snap->time_sum / APR_USEC_PER_SEC);
+    status_text_buf_vputs(out, "\n", name, "_count ", NULL);
+    status_text_buf_u64(out, cumul);
+    status_text_buf_putc(out, '\n');
+}
+
+/* print the keys in the prometheus text exposition format, a family at a
+ * time */
+static void status_text_print_prometheus(status_text_ctx_t *ctx)
+{
+    status_text_buf_t *out = ctx->out;
+    const status_text_family_t *family;
+    const status_text_key_t *key;
+    double value;
+    int f, i, n;
+
+    for (f = 0; f < status_text_families->nelts; ++f)
+    {
+      family = STATUS_TEXT_FAMILY(f);
+
+      /* strings: labels of a single info sample */
+      if (strcmp(family->type, "info") == 0)
+      {
+        for (i = family->first, n = 0; i >= 0; i = STATUS_TEXT_KEY(i)->next)
+        {
+          if (!STATUS_TEXT_KEY_PRINTED(ctx, i)) continue;
+          status_text_buf_vputs(out, n++ ? "," : "# TYPE apache_info gauge\napache_info{", STATUS_TEXT_KEY(i)->labels, "=", NULL);
+          ctx->format = STATUS_TEXT_FORMAT_JSON; /* quoted and escaped */
+          status_text_print_key(ctx, STATUS_TEXT_KEY(i));
+          ctx->format = STATUS_TEXT_FORMAT_PROMETHEUS;
+        }
+        if (n) status_text_buf_puts(out, "} 1\n");
+        continue;
+      }
+
+      for (i = family->first, n = 0; i >= 0; i = key->next)
+      {
+        key = STATUS_TEXT_KEY(i);
+        if (!STATUS_TEXT_KEY_PRINTED(ctx, i)) continue;
+        if (n++ == 0) status_text_buf_vputs(out, "# TYPE ", family->name, " ", family->type, "\n", NULL);
+        if (key->id == STATUS_TEXT_KEY_LATENCY)
+        {
+          status_text_print_prometheus_histogram(ctx, family->name);
+          continue;
+        }
+        if (!status_text_key_number(ctx, key, &value)) continue;
+        status_text_buf_puts(out, family->name);
+        if (key->labels) status_text_buf_vputs(out, "{", key->labels, "}", NULL);
+        status_text_buf_printf(out, " %.17g\n", value * family->scale);
+      }
+    }
+}
 
-    ap_mpm_query(AP_MPMQ_MAX_DAEMON_USED, &max_daemons);
+/* metric of the binary output */
+typedef struct {
+    const status_text_key_t *key;
+    int kind;             /* STATUS_TEXT_BINARY_* */
+    apr_uint32_t count;   /* values, bytes of a string or histogram pairs */
+    apr_uint32_t name;    /* offset of the name in the names */
+    apr_uint32_t data;    /* offset of the values in the data */
+    double value;         /* value of a STATUS_TEXT_BINARY_F64 metric */
+    const char *string;   /* value of a STATUS_TEXT_BINARY_STRING metric */
+} status_text_binary_entry_t;
+
+#define STATUS_TEXT_PAD8(n) (((n) + 7) & ~(apr_uint32_t)7)
 
-    /* api rest */
-    if (r->args) 
+/* integer of n bytes in little endian */
+static void status_text_buf_le(status_text_buf_t *b, apr_uint64_t v, int n)
+{
+    STATUS_TEXT_BUF_RESERVE(b, n);
+    while (n--)
     {
-       if (strcasecmp(r->args,"ModuleVersion")==0)
-       {
-         ap_rvputs(r, MOD_VERSION, "\n", NULL);
-         return 0;
-       } 
-       else if (strcasecmp(r->args,"ApacheServerRoot")==0)
-       {
-         ap_rvputs(r, ap_server_root, "\n", NULL);
-         return 0;
-       } 
-       else if (strcasecmp(r->args,"ApacheServerDocumentRoot")==0)
-       {
-         ap_rvputs(r, ap_document_root(r), "\n", NULL);
-         return 0;
-       }
-       else if (strcasecmp(r->args,"ApacheServerConfigFile")==0)
-       {
-         ap_rvputs(r, ap_conftree->filename, "\n", NULL);
-         return 0;
-       }
-       else if (strcasecmp(r->args,"ApacheServerName")==0)
-       {
-         ap_rvputs(r, ap_get_server_name(r), "\n", NULL);
-         return 0;
-       }
-       else if (strcasecmp(r->args,"ApacheServerPort")==0)
-       {
-         ap_rprintf(r, "%d\n", ap_get_server_port(r));
-         return 0;
-       }
-       else if (strcasecmp(r->args,"ApacheListen/count")==0)
-       {
-	 lr_count=0;
-	 for (lr = ap_listeners; lr != NULL; lr = lr->next) lr_count++;
-	 ap_rprintf(r, "%d\n", lr_count);
-         return 0;
-       }
-       else if (strncasecmp(r->args,"ApacheListen/",13)==0)
-       {
-	 int args_index_len=strlen(r->args+13);
-	 int listener_index=0;
-	 if (args_index_len>0) {
-	   listener_index=apr_atoi64(r->args+13);
-	   if (listener_index>=0) 
-	   {
-	     lr_count=0;
-	     for (lr = ap_listeners; lr != NULL; lr = lr->next) 
-	     {
-		if (lr->active&&lr_count==listener_index) 
-		{
-                  if (lr->bind_addr->hostname)
-		  ap_rprintf(r, "%s://%s:%d\n",
-		       lr->protocol,
-		       lr->bind_addr->hostname,
-		       lr->bind_addr->port);
-                  else
-		  ap_rprintf(r, "%s://0.0.0.0:%d\n",
-		       lr->protocol,
-		       lr->bind_addr->port);
-		}
-		lr_count++;
-	     }
-	   }
-	 }
-	 if (lr_count<=listener_index) ap_rprintf(r,"Bad Index!\n");
-         return 0;
-       }
-       else if (strcasecmp(r->args,"ApacheServerVersion")==0)
-       {
-         ap_rvputs(r, AP_SERVER_BASEVERSION " (" PLATFORM ")", "\n", NULL);
-         return 0;
-       }
-       else if (strcasecmp(r->args,"ApacheServerBuilt")==0)
-       {
-         ap_rvputs(r, ap_get_server_built(), "\n", NULL);
-         return 0;
-       }
-       else if (strcasecmp(r->args,"ApacheAprVersion")==0)
-       {
-         ap_rvputs(r, apr_version_string(), "\n", NULL);
-         return 0;
-       }
-       else if (strcasecmp(r->args,"ApacheAprBuildVersion")==0)
-       {
-         ap_rvputs(r, APR_VERSION_STRING, "\n", NULL);
-         return 0;
-       }
-       else if (strcasecmp(r->args,"ApacheApuVersion")==0)
-       {
-         ap_rvputs(r, apu_version_string(), "\n", NULL);
-         return 0;
-       }
-       else if (strcasecmp(r->args,"ApacheApuBuildVersion")==0)
-       {
-         ap_rvputs(r, APU_VERSION_STRING, "\n", NULL);
-         return 0;
-       }
-       else if (strcasecmp(r->args,"ApacheServerMPM")==0)
-       {
-         ap_rprintf(r, "%s\n", ap_show_mpm());
-         return 0;
-       }
-       else if (strcasecmp(r->args,"ApacheThreaded")==0)
-       {
-         ap_rprintf(r, "%s\n",threaded ? "yes" : "no");
-         return 0;
-       }
-       else if (strcasecmp(r->args,"ApacheForked")==0)
-       {
-         ap_rprintf(r, "%s\n",forked ? "yes" : "no");
-         return 0;
-       }
-       else if (strcasecmp(r->args,"ApacheServerArchitecture")==0)
-       {
-         ap_rprintf(r, "%ld\n", 8 * (long) sizeof(void *));
-         return 0;
-       }
-       else if (strcasecmp(r->args,"ApacheTimeout")==0)
-       {
-         ap_rprintf(r, "%d\n", (int) (apr_time_sec(r->server->timeout)));
-         return 0;
-       }
-       else if (strcasecmp(r->args,"ApacheKeepAliveTimeout")==0)
-       {
-         ap_rprintf(r, "%d\n", (int) (apr_time_sec(r->server->keep_alive_timeout)));
-         return 0;
-       }
-       else if (strcasecmp(r->args,"ApacheParentServerGeneration")==0)
-       {
-         ap_rprintf(r, "%d\n", (int)ap_my_generation);
-         return 0;
-       }
-       else if (strcasecmp(r->args,"ApacheCurrentTime")==0)
-       {
-         ap_rprintf(r, "%"APR_TIME_T_FMT"\n", nowtime);
-         return 0;
-       }
-       else if (strcasecmp(r->args,"ApacheThreadLimit")==0)
-       {
-         ap_rprintf(r, "%u\n", thread_limit);
-         return 0;
-       }
-       else if (strcasecmp(r->args,"ApacheServerLimit")==0)
-       {
-         ap_rprintf(r, "%u\n", server_limit);
-         return 0;
-       }
-       else if (strcasecmp(r->args,"ApacheRestartTime")==0)
-       {
-         ap_rprintf(r, "%"APR_TIME_T_FMT"\n", ap_scoreboard_image->global->restart_time);
-         return 0;
-       }
-       else if (strcasecmp(r->args,"ApacheServerUptime")==0)
-       {
-         ap_rprintf(r, "%ld\n", (long) (up_time));
-         return 0;
-       }
-       else if (strcasecmp(r->args,"ApacheTotalAccesses")==0)
-       {
-	 ap_rprintf(r, "%" APR_UINT64_T_FMT "\n", count);
-         return 0;
-       }
-       else if (strcasecmp(r->args,"ApacheTotalKBytes")==0)
-       {
-	 ap_rprintf(r, "%" APR_UINT64_T_FMT "\n", kbcount);
-         return 0;
-       }
-       else if (strcasecmp(r->args,"ApacheMaxWorker")==0)
-       {
-	 ap_rprintf(r, "%d\n",max_daemons);
-         return 0;
-       }
-       else if (strcasecmp(r->args,"ApacheBusyWorkers")==0)
-       {
-	 ap_rprintf(r, "%d\n", busy);
-         return 0;
-       }
-       else if (strcasecmp(r->args,"ApacheIdleWorkers")==0)
-       {
-	 ap_rprintf(r, "%d\n", ready);
-         return 0;
-       }
-       /* number of request per status code */
-       else if (strcasecmp(r->args,"Apache_NB_Reqs_xxx")==0)
-       {
-	  ap_rprintf(r, "%"APR_UINT64_T_FMT"\n", st_sb_total.nb_reqs_xxx);
-	  return 0;
-       }
-       else if (strcasecmp(r->args,"Apache_NB_Reqs_10x")==0)
-       {
-	  ap_rprintf(r, "%"APR_UINT64_T_FMT"\n", st_sb_total.nb_reqs_10x);
-	  return 0;
-       }
-       else if (strcasecmp(r->args,"Apache_NB_Reqs_200")==0)
-       {
-	  ap_rprintf(r, "%"APR_UINT64_T_FMT"\n", st_sb_total.nb_reqs_200);
-	  return 0;
-       }
-       else if (strcasecmp(r->args,"Apache_NB_Reqs_20x")==0)
-       {
-	  ap_rprintf(r, "%"APR_UINT64_T_FMT"\n", st_sb_total.nb_reqs_20x);
-	  return 0;
-       }
-       else if (strcasecmp(r->args,"Apache_NB_Reqs_301")==0)
-       {
-	  ap_rprintf(r, "%"APR_UINT64_T_FMT"\n", st_sb_total.nb_reqs_301);
-	  return 0;
-       }
-       else if (strcasecmp(r->args,"Apache_NB_Reqs_302")==0)
-       {
-	  ap_rprintf(r, "%"APR_UINT64_T_FMT"\n", st_sb_total.nb_reqs_302);
-	  return 0;
-       }
-       else if (strcasecmp(r->args,"Apache_NB_Reqs_304")==0)
-       {
-	  ap_rprintf(r, "%"APR_UINT64_T_FMT"\n", st_sb_total.nb_reqs_304);
-	  return 0;
-       }
-       else if (strcasecmp(r->args,"Apache_NB_Reqs_30x")==0)
-       {
-	  ap_rprintf(r, "%"APR_UINT64_T_FMT"\n", st_sb_total.nb_reqs_30x);
-	  return 0;
-       }
-       else if (strcasecmp(r->args,"Apache_NB_Reqs_404")==0)
-       {
-	  ap_rprintf(r, "%"APR_UINT64_T_FMT"\n", st_sb_total.nb_reqs_404);
-	  return 0;
-       }
-       else if (strcasecmp(r->args,"Apache_NB_Reqs_40x")==0)
-       {
-	  ap_rprintf(r, "%"APR_UINT64_T_FMT"\n", st_sb_total.nb_reqs_40x);
-	  return 0;
-       }
-       else if (strcasecmp(r->args,"Apache_NB_Reqs_50x")==0)
-       {
-	  ap_rprintf(r, "%"APR_UINT64_T_FMT"\n", st_sb_total.nb_reqs_50x);
-	  return 0;
-       }
+      b->buf[b->len++] = (char)(v & 0xff);
+      v >>= 8;
+    }
+}
 
-       /* number of bytes per status code */
-       else if (strcasecmp(r->args,"Apache_NB_Bytes_xxx")==0)
-       {
-	  ap_rprintf(r, "%" APR_UINT64_T_FMT "\n", st_sb_total.nb_bytes_xxx);
-	  return 0;
-       }
-       else if (strcasecmp(r->args,"Apache_NB_Bytes_10x")==0)
-       {
-	  ap_rprintf(r, "%" APR_UINT64_T_FMT "\n", st_sb_total.nb_bytes_10x);
-	  return 0;
-       }
-       else if (strcasecmp(r->args,"Apache_NB_Bytes_200")==0)
-       {
-	  ap_rprintf(r, "%" APR_UINT64_T_FMT "\n", st_sb_total.nb_bytes_200);
-	  return 0;
-       }
-       else if (strcasecmp(r->args,"Apache_NB_Bytes_20x")==0)
-       {
-	  ap_rprintf(r, "%" APR_UINT64_T_FMT "\n", st_sb_total.nb_bytes_20x);
-	  return 0;
-       }
-       else if (strcasecmp(r->args,"Apache_NB_Bytes_301")==0)
-       {
-	  ap_rprintf(r, "%" APR_UINT64_T_FMT "\n", st_sb_total.nb_bytes_301);
-	  return 0;
-       }
-       else if (strcasecmp(r->args,"Apache_NB_Bytes_302")==0)
-       {
-	  ap_rprintf(r, "%" APR_UINT64_T_FMT "\n", st_sb_total.nb_bytes_302);
-	  return 0;
-       }
-       else if (strcasecmp(r->args,"Apache_NB_Bytes_304")==0)
-       {
-	  ap_rprintf(r, "%" APR_UINT64_T_FMT "\n", st_sb_total.nb_bytes_304);
-	  return 0;
-       }
-       else if (strcasecmp(r->args,"Apache_NB_Bytes_30x")==0)
-       {
-	  ap_rprintf(r, "%" APR_UINT64_T_FMT "\n", st_sb_total.nb_bytes_30x);
-	  return 0;
-       }
-       else if (strcasecmp(r->args,"Apache_NB_Bytes_404")==0)
-       {
-	  ap_rprintf(r, "%" APR_UINT64_T_FMT "\n", st_sb_total.nb_bytes_404);
-	  return 0;
-       }
-       else if (strcasecmp(r->args,"Apache_NB_Bytes_40x")==0)
-       {
-	  ap_rprintf(r, "%" APR_UINT64_T_FMT "\n", st_sb_total.nb_bytes_40x);
-	  return 0;
-       }
-       else if (strcasecmp(r->args,"Apache_NB_Bytes_50x")==0)
-       {
-	  ap_rprintf(r, "%" APR_UINT64_T_FMT "\n", st_sb_total.nb_bytes_50x);
-	  return 0;
-       }
+static void status_text_buf_zeros(status_text_buf_t *b, apr_size_t n)
+{
+    STATUS_TEXT_BUF_RESERVE(b, n);
+    memset(b->buf + b->len, 0, n);
+    b->len += n;
+}
 
-       /* number of request per response times range */
-       else if (strcasecmp(r->args,"Apache_NB_Reqs_50ms")==0)
-       {
-	  ap_rprintf(r, "%"APR_TIME_T_FMT"\n", st_sb_total.nb_reqs_50ms);
-	  return 0;
-       }
-       else if (strcasecmp(r->args,"Apache_NB_Reqs_100ms")==0)
-       {
-	  ap_rprintf(r, "%"APR_TIME_T_FMT"\n", st_sb_total.nb_reqs_100ms);
-	  return 0;
-       }
-       else if (strcasecmp(r->args,"Apache_NB_Reqs_300ms")==0)
-       {
-	  ap_rprintf(r, "%"APR_TIME_T_FMT"\n", st_sb_total.nb_reqs_300ms);
-	  return 0;
-       }
-       else if (strcasecmp(r->args,"Apache_NB_Reqs_500ms")==0)
-       {
-	  ap_rprintf(r, "%"APR_TIME_T_FMT"\n", st_sb_total.nb_reqs_500ms);
-	  return 0;
-       }
-       else if (strcasecmp(r->args,"Apache_NB_Reqs_1s")==0)
-       {
-	  ap_rprintf(r, "%"APR_TIME_T_FMT"\n", st_sb_total.nb_reqs_1s);
-	  return 0;
-       }
-       else if (strcasecmp(r->args,"Apache_NB_Reqs_1_5s")==0)
-       {
-	  ap_rprintf(r, "%"APR_TIME_T_FMT"\n", st_sb_total.nb_reqs_1_5s);
-	  return 0;
-       }
-       else if (strcasecmp(r->args,"Apache_NB_Reqs_2s")==0)
-       {
-	  ap_rprintf(r, "%"APR_TIME_T_FMT"\n", st_sb_total.nb_reqs_2s);
-	  return 0;
-       }
-       else if (strcasecmp(r->args,"Apache_NB_Reqs_5s")==0)
-       {
-	  ap_rprintf(r, "%"APR_TIME_T_FMT"\n", st_sb_total.nb_reqs_5s);
-	  return 0;
-       }
-       else if (strcasecmp(r->args,"Apache_NB_Reqs_10s")==0)
-       {
-	  ap_rprintf(r, "%"APR_TIME_T_FMT"\n", st_sb_total.nb_reqs_10s);
-	  return 0;
-       }
-       else if (strcasecmp(r->args,"Apache_NB_Reqs_15s")==0)
-       {
-	  ap_rprintf(r, "%"APR_TIME_T_FMT"\n", st_sb_total.nb_reqs_15s);
-	  return 0;
-       }
-       else if (strcasecmp(r->args,"Apache_NB_Reqs_20s")==0)
-       {
-	  ap_rprintf(r, "%"APR_TIME_T_FMT"\n", st_sb_total.nb_reqs_20s);
-	  return 0;
-       }
-       else if (strcasecmp(r->args,"Apache_NB_Reqs_30s")==0)
-       {
-	  ap_rprintf(r, "%"APR_TIME_T_FMT"\n", st_sb_total.nb_reqs_30s);
-	  return 0;
-       }
-       else if (strcasecmp(r->args,"Apache_NB_Reqs_xs")==0)
-       {
-	  ap_rprintf(r, "%"APR_TIME_T_FMT"\n", st_sb_total.nb_reqs_xs);
-	  return 0;
-       }
-       else if (strcasecmp(r->args,"Apache_Avg_ResponseTime")==0)
-       {
-	  ap_rprintf(r, "%"APR_TIME_T_FMT"\n", st_sb_total.avg);
-	  return 0;
-       }
-       else if (strcasecmp(r->args,"Apache_90Percentil_ResponseTime")==0)
-       {
-	  ap_rprintf(r, "%"APR_TIME_T_FMT"\n", st_sb_total.percentil);
-	  return 0;
-       }
+/* 32 bits FNV-1a hash of a key name, its id in the binary output */
+static apr_uint32_t status_text_fnv32(const char *s)
+{
+    apr_uint32_t h = 2166136261u;
+
+    while (*s)
+    {
+      h ^= (unsigned char)*s++;
+      h *= 16777619u;
+    }
+    return h;
+}
+
+/* print the keys as a binary snapshot (see status_text_binary.h): the
+ * values are written from the snapshot as they are, the sizes and offsets
+ * are computed first */
+static void status_text_print_binary(status_text_ctx_t *ctx)
+{
+    status_text_buf_t *out = ctx->out;
+    const status_text_snapshot_t *snap = ctx->snap;
+    status_text_binary_entry_t *entries, *e;
+    apr_uint32_t names_size = 0, data_size = 0, size;
+    int i, k, n = 0;
+
+    /* the metrics and their sizes */
+    entries = apr_palloc(ctx->r->pool, sizeof(status_text_binary_entry_t) * (status_text_keys->nelts + 1));
+    for (i = 0; i < status_text_keys->nelts; ++i)
+    {
+      if (!STATUS_TEXT_KEY_PRINTED(ctx, i)) continue;
+      e = &entries[n];
+      e->key = STATUS_TEXT_KEY(i);
+      switch (e->key->type)
+      {
+        case STATUS_TEXT_TYPE_STRING:
+          if ((e->string = status_text_key_string(ctx, e->key)) == NULL) continue;
+          e->kind = STATUS_TEXT_BINARY_STRING;
+          e->count = strlen(e->string);
+          size = e->count;
+          break;
+        case STATUS_TEXT_TYPE_HISTOGRAM:
+          e->kind = STATUS_TEXT_BINARY_HISTOGRAM;
+          for (k = 0, e->count = 0; k < STATUS_TEXT_HIST_BUCKETS; ++k)
+            if (snap->hist[k]) e->count++;
+          size = e->count * 16;
+          break;
+        case STATUS_TEXT_TYPE_SERIES:
+          e->kind = STATUS_TEXT_BINARY_U64_ARRAY;
+          e->count = status_text_series_seconds;
+          size = e->count * 8;
+          break;
+        default:
+          if (!status_text_key_number(ctx, e->key, &e->value)) continue;
+          e->kind = STATUS_TEXT_BINARY_F64;
+          e->count = 1;
+          size = 8;
+      }
+      e->name = names_size;
+      e->data = data_size;
+      names_size += strlen(e->key->name) + 1;
+      data_size += STATUS_TEXT_PAD8(size);
+      ++n;
+    }
+    names_size = STATUS_TEXT_PAD8(names_size);
+
+    /* header */
+    status_text_buf_putsn(out, STATUS_TEXT_BINARY_MAGIC, 4);
+    status_text_buf_le(out, STATUS_TEXT_BINARY_VERSION, 2);
+    status_text_buf_le(out, STATUS_TEXT_BINARY_HEADER_SIZE, 2);
+    status_text_buf_le(out, n, 4);
+    status_text_buf_le(out, STATUS_TEXT_BINARY_ENTRY_SIZE, 4);
+    status_text_buf_le(out, names_size, 4);
+    status_text_buf_le(out, data_size, 4);
+    status_text_buf_le(out, ctx->nowtime, 8);
+    status_text_buf_le(out, ap_scoreboard_image->global->restart_time, 8);
+    status_text_buf_le(out, (apr_uint32_t)ctx->generation, 4);
+    status_text_buf_le(out, 0, 4);
+
+    /* metric table */
+    for (i = 0; i < n; ++i)
+    {
+      e = &entries[i];
+      status_text_buf_le(out, status_text_fnv32(e->key->name), 4);
+      status_text_buf_le(out, e->kind, 1);
+      status_text_buf_le(out, e->key->type, 1);
+      status_text_buf_le(out, 0, 2);
+      status_text_buf_le(out, e->name, 4);
+      status_text_buf_le(out, e->count, 4);
+      status_text_buf_le(out, e->data, 4);
+      status_text_buf_le(out, 0, 4);
+    }
+
+    /* names */
+    for (i = 0, size = 0; i < n; ++i)
+    {
+      status_text_buf_putsn(out, entries[i].key->name, strlen(entries[i].key->name) + 1);
+      size += strlen(entries[i].key->name) + 1;
+    }
+    status_text_buf_zeros(out, names_size - size);
+
+    /* data */
+    for (i = 0; i < n; ++i)
+    {
+      e = &entries[i];
+      switch (e->kind)
+      {
+        case STATUS_TEXT_BINARY_STRING:
+          status_text_buf_putsn(out, e->string, e->count);
+          status_text_buf_zeros(out, STATUS_TEXT_PAD8(e->count) - e->count);
+          break;
+        case STATUS_TEXT_BINARY_HISTOGRAM:
+          for (k = 0; k < STATUS_TEXT_HIST_BUCKETS; ++k)
+          {
+            if (snap->hist[k] == 0) continue;
+            status_text_buf_le(out, status_text_hist_upper(k), 8);
+            status_text_buf_le(out, snap->hist[k], 8);
+          }
+          break;
+        case STATUS_TEXT_BINARY_U64_ARRAY:
+          for (k = 0; k < status_text_series_seconds; ++k)
+          {
+            const status_text_series_t *second = &snap->series[k];
+            switch (e->key->arg)
+            {
+              case 1: status_text_buf_le(out, second->reqs, 8); break;
+              case 2: status_text_buf_le(out, second->bytes, 8); break;
+              case 3: status_text_buf_le(out, second->reqs_4xx, 8); break;
+              case 4: status_text_buf_le(out, second->reqs_5xx, 8); break;
+              default: status_text_buf_le(out, status_text_series_percentile(second, 990), 8);
+            }
+          }
+          break;
+        default:
+          status_text_buf_le(out, status_text_double_bits(e->value), 8);
+      }
+    }
+}
+
+/* worker states of the workers= filter, as a mask of 1 << SERVER_* */
+#define STATUS_TEXT_STATE(s) (1 << (s))
+#define STATUS_TEXT_STATES_BUSY (STATUS_TEXT_STATE(SERVER_BUSY_READ) | STATUS_TEXT_STATE(SERVER_BUSY_WRITE) | \
+        STATUS_TEXT_STATE(SERVER_BUSY_KEEPALIVE) | STATUS_TEXT_STATE(SERVER_BUSY_LOG) | \
+        STATUS_TEXT_STATE(SERVER_BUSY_DNS) | STATUS_TEXT_STATE(SERVER_CLOSING) | \
+        STATUS_TEXT_STATE(SERVER_GRACEFUL))
+
+static const struct {
+    const char *name;
+    int states;
+} status_text_worker_states[] = {
+    { "all", -1 },
+    { "none", 0 },
+    { "busy", STATUS_TEXT_STATES_BUSY },
+    { "ready", STATUS_TEXT_STATE(SERVER_READY) },
+    { "starting", STATUS_TEXT_STATE(SERVER_STARTING) },
+    { "read", STATUS_TEXT_STATE(SERVER_BUSY_READ) },
+    { "write", STATUS_TEXT_STATE(SERVER_BUSY_WRITE) },
+    { "keepalive", STATUS_TEXT_STATE(SERVER_BUSY_KEEPALIVE) },
+    { "logging", STATUS_TEXT_STATE(SERVER_BUSY_LOG) },
+    { "dns", STATUS_TEXT_STATE(SERVER_BUSY_DNS) },
+    { "closing", STATUS_TEXT_STATE(SERVER_CLOSING) },
+    { "dead", STATUS_TEXT_STATE(SERVER_DEAD) },
+    { "graceful", STATUS_TEXT_STATE(SERVER_GRACEFUL) },
+    { "dying", STATUS_TEXT_STATE(SERVER_IDLE_KILL) },
+    { NULL, 0 }
+};
+
+/* query of the handler */
+typedef struct {
+    int format;        /* STATUS_TEXT_FORMAT_* */
+    const char *key;   /* single key, NULL if none */
+    char *keys;        /* keys= list, NULL if none */
+    /* worker lines of the full text output */
+    int worker_states; /* states printed (STATUS_TEXT_STATE), 0 for none */
+    int child;         /* child index, -1 for all */
+    apr_time_t min_duration; /* minimum ReqTime (in microseconds) */
+    int offset;        /* number of matching lines skipped */
+    int limit;         /* maximum number of lines, -1 for no limit */
+    const char *since; /* token of the since= snapshot, NULL if none */
+} status_text_query_t;
+
+static const char *status_text_parse_time(const char *arg, apr_time_t *value);
+
+/* parse the workers= list of states, return 0 if a state is unknown */
+static int status_text_parse_states(char *list, int *states)
+{
+    char *name, *last;
+    int i;
+
+    *states = 0;
+    for (name = apr_strtok(list, ",", &last); name; name = apr_strtok(NULL, ",", &last))
+    {
+      for (i = 0; status_text_worker_states[i].name; ++i)
+        if (strcasecmp(name, status_text_worker_states[i].name) == 0) break;
+      if (status_text_worker_states[i].name == NULL) return 0;
+      *states |= status_text_worker_states[i].states;
+    }
+    return 1;
+}
+
+/* parse the query: a single key, or name=value parameters: keys=<key>,...
+ * and format=text|prometheus|json. without format= the format is chosen
+ * from the Accept header. the worker lines are filtered by
+ * workers=<state>,..., child=<index> and min_duration=<time>, and paged by
+ * offset= and limit=. since=<token> prints only what changed since a
+ * snapshot. the invalid values are ignored */
+static void status_text_parse_query(request_rec *r, status_text_query_t *q)
+{
+    const char *accept = apr_table_get(r->headers_in, "Accept");
+    char *args, *param, *value, *last;
+
+    q->format = STATUS_TEXT_FORMAT_TEXT;
+    q->key = NULL;
+    q->keys = NULL;
+    q->worker_states = -1;
+    q->child = -1;
+    q->min_duration = 0;
+    q->offset = 0;
+    q->limit = -1;
+    q->since = NULL;
+    if (accept)
+    {
+      if (ap_strcasestr(accept, "application/json"))
+        q->format = STATUS_TEXT_FORMAT_JSON;
+      else if (ap_strcasestr(accept, STATUS_TEXT_BINARY_CONTENT_TYPE))
+        q->format = STATUS_TEXT_FORMAT_BINARY;
+      else if (ap_strcasestr(accept, "version=0.0.4") || ap_strcasestr(accept, "application/openmetrics-text"))
+        q->format = STATUS_TEXT_FORMAT_PROMETHEUS;
+    }
+
+    if (!r->args || !*r->args) return;
+    if (!strchr(r->args, '='))
+    {
+      /* a single key, in a snapshot of one metric in binary */
+      if (q->format == STATUS_TEXT_FORMAT_BINARY) q->keys = apr_pstrdup(r->pool, r->args);
+      else q->key = r->args;
+      return;
+    }
+
+    args = apr_pstrdup(r->pool, r->args);
+    for (param = apr_strtok(args, "&", &last); param; param = apr_strtok(NULL, "&", &last))
+    {
+      value = strchr(param, '=');
+      if (!value) continue;
+      *value++ = '\0';
+      ap_unescape_url(value);
+      if (strcasecmp(param, "keys") == 0)
+        q->keys = value;
+      else if (strcasecmp(param, "format") == 0)
+      {
+        if (strcasecmp(value, "prometheus") == 0) q->format = STATUS_TEXT_FORMAT_PROMETHEUS;
+        else if (strcasecmp(value, "json") == 0) q->format = STATUS_TEXT_FORMAT_JSON;
+        else if (strcasecmp(value, "binary") == 0) q->format = STATUS_TEXT_FORMAT_BINARY;
+        else q->format = STATUS_TEXT_FORMAT_TEXT;
+      }
+      else if (strcasecmp(param, "workers") == 0)
+      {
+        int states;
+        if (status_text_parse_states(value, &states)) q->worker_states = states;
+      }
+      else if (strcasecmp(param, "child") == 0)
+      {
+        if (apr_isdigit(*value)) q->child = atoi(value);
+      }
+      else if (strcasecmp(param, "min_duration") == 0)
+        status_text_parse_time(value, &q->min_duration);
+      else if (strcasecmp(param, "offset") == 0)
+      {
+        if (apr_isdigit(*value)) q->offset = atoi(value);
+      }
+      else if (strcasecmp(param, "since") == 0)
+        q->since = value;
+      else if (strcasecmp(param, "limit") == 0)
+      {
+        if (apr_isdigit(*value)) q->limit = atoi(value);
+      }
+    }
+}
+
+/* select the keys of a keys= list, return the parts of the aggregated
+ * statistics they need */
+static int status_text_select_keys(status_text_ctx_t *ctx, char *list)
+{
+    const status_text_key_t *key;
+    char *name, *last;
+    int needs = 0;
+
+    ctx->names = apr_array_make(ctx->r->pool, 16, sizeof(const char *));
+    ctx->selected = apr_pcalloc(ctx->r->pool, status_text_keys->nelts);
+    for (name = apr_strtok(list, ",", &last); name; name = apr_strtok(NULL, ",", &last))
+    {
+      *(const char **)apr_array_push(ctx->names) = name;
+      key = status_text_find_key(name);
+      if (key == NULL) continue;
+      ctx->selected[key - STATUS_TEXT_KEY(0)] = 1;
+      needs |= key->needs;
+    }
+    return needs;
+}
+
+/* print the value of a single key query */
+static void status_text_print_single(status_text_ctx_t *ctx, const char *name)
+{
+    const status_text_key_t *key = status_text_find_key(name);
+
+    if (key == NULL)
+    {
+      if (strncasecmp(name, "ApacheListen/", 13) == 0) status_text_buf_puts(ctx->out, "Bad Index!\n");
+      else status_text_buf_puts(ctx->out, "Unknown Attribut!\n");
+      return;
+    }
+    if (key->needs) ctx->snap = status_text_get_snapshot(ctx->r, key->needs);
+    status_text_print_key(ctx, key);
+    status_text_buf_puts(ctx->out, "\n");
+}
+/* Main handler for x-httpd-status-text requests */
+static int status_text_handler(request_rec *r)
+{
+    apr_time_t nowtime;
+    apr_interval_time_t up_time;
+    int max_daemons;
+    int j, i, block;
+    apr_uint64_t lres, my_lres, conn_lres;
+    apr_uint64_t bytes, my_bytes, conn_bytes;
+    long req_time;
+#ifdef HAVE_TIMES
+    float tick;
+#endif
+    worker_score ws_record_st;
+    worker_score *ws_record=&ws_record_st;
+    process_score *ps_record;
+    pid_t worker_pid;
+    ap_generation_t worker_generation;
+    apr_time_t monotonic_now;
+    double *worker_hist;
+
+    /* query and printed keys */
+    status_text_query_t query;
+    status_text_ctx_t ctx;
+    int needs, rows, nb, marked_only, empty;
+    status_text_buf_t out_buf, *out = &out_buf;
+    status_text_buf_t lines_buf, *lines = &lines_buf;
+    status_text_snapshot_t *snap = NULL;
+    status_text_cpu_t proc;
+    apr_uint64_t bcount;
+    int matched;
+    apr_uint32_t delta_seq, delta_nb_old, delta_pos, delta_nb_new;
+    apr_uint64_t *delta_old, *delta_workers, row_hash, old_hash;
+    apr_size_t row_skip_start, row_skip_end;
+
+    /* get status text scoreboard share memory */
+    status_text_scoreboard_t *st_sb_cur;
+    status_text_scoreboard_cold_t st_sb_cold;
+
+    if (strcmp(r->handler, STATUS_MAGIC_TYPE) && strcmp(r->handler, "server-status-text")) 
+        return DECLINED;
+
+#ifdef HAVE_TIMES
+#ifdef _SC_CLK_TCK
+    tick = sysconf(_SC_CLK_TCK);
+#else
+    tick = HZ;
+#endif
+#endif
+
+#if AP_MODULE_MAGIC_AT_LEAST(20090401,1)
+    ap_generation_t ap_my_generation;
+    ap_mpm_query(AP_MPMQ_GENERATION, &ap_my_generation);
+#endif
+
+    nowtime = apr_time_now();
+
+    if (!ap_exists_scoreboard_image()) 
+    {
+        ap_log_rerror(APLOG_MARK, APLOG_ERR, 0, r,
+                      "Server status unavailable in inetd mode");
+        return HTTP_INTERNAL_SERVER_ERROR;
+    }
+
+    r->allowed = (AP_METHOD_BIT << M_GET);
+    if (r->method_number != M_GET)
+        return DECLINED;
+
+    status_text_parse_query(r, &query);
+    if (query.format == STATUS_TEXT_FORMAT_PROMETHEUS)
+      ap_set_content_type(r, "text/plain; version=0.0.4; charset=utf-8");
+    else if (query.format == STATUS_TEXT_FORMAT_JSON)
+      ap_set_content_type(r, "application/json");
+    else if (query.format == STATUS_TEXT_FORMAT_BINARY)
+      ap_set_content_type(r, STATUS_TEXT_BINARY_CONTENT_TYPE);
+    else
+      ap_set_content_type(r, "text/plain; charset=ISO-8859-1");
+
+    /* up_time in seconds */
+    up_time = (apr_uint32_t) apr_time_sec(nowtime -
+                               ap_scoreboard_image->global->restart_time);
+
+    ap_mpm_query(AP_MPMQ_MAX_DAEMON_USED, &max_daemons);
+
+    ctx.r = r;
+    ctx.snap = NULL;
+    ctx.nowtime = nowtime;
+    ctx.up_time = up_time;
+    ctx.max_daemons = max_daemons;
+    ctx.generation = ap_my_generation;
 #ifdef HAVE_TIMES
-       else if (strcasecmp(r->args,"ApacheCPUUsage.User")==0)
-       {
-	 ap_rprintf(r, "%g\n", tu / tick);
-         return 0;
-       }
-       else if (strcasecmp(r->args,"ApacheCPUUsage.System")==0)
-       {
-	 ap_rprintf(r, "%g\n", ts / tick);
-         return 0;
-       }
-       else if (strcasecmp(r->args,"ApacheChildCPUUsage.User")==0)
-       {
-	 ap_rprintf(r, "%g\n", tcu / tick);
-         return 0;
-       }
-       else if (strcasecmp(r->args,"ApacheChildCPUUsage.System")==0)
-       {
-	 ap_rprintf(r, "%g\n", tcs / tick);
-         return 0;
-       }
-       else if (strcasecmp(r->args,"ApacheCPULoad")==0)
-       {
-	 if (ts || tu || tcu || tcs)
-	     ap_rprintf(r, "%g\n",
-			(tu + ts + tcu + tcs) / tick / up_time * 100.);
-         else
-	     ap_rprintf(r, "na\n");
-         return 0;
-       }
+    ctx.tick = tick;
 #endif
-       else
-       {
-	 ap_rprintf(r, "Unknown Attribut!\n");
-         return 0;
-       }
+    ctx.out = out;
+    ctx.format = query.format;
+    ctx.listing = 0;
+    ctx.names = NULL;
+    ctx.selected = NULL;
+    ctx.delta_old = NULL;
+    ctx.delta_new = NULL;
+
+    /* api rest: the value of a single key */
+    if (query.key) 
+    {
+       status_text_buf_init(out, r, 0);
+       status_text_print_single(&ctx, query.key);
+       status_text_buf_flush(out);
+       return 0;
     }
 
-    /* without argument print all */
+    /* output buffer sized for the keys */
+    status_text_buf_init(out, r, status_text_keys->nelts * STATUS_TEXT_BUF_KEY);
 
-    ap_rvputs(r, "ModuleVersion: ", MOD_VERSION, "\n", NULL);
-    ap_rvputs(r, "ApacheServerRoot: ", 		ap_server_root, "\n", NULL);
-    ap_rvputs(r, "ApacheServerDocumentRoot: ", 		ap_document_root(r), "\n", NULL);
-    ap_rvputs(r, "ApacheServerConfigFile: ", 		ap_conftree->filename, "\n", NULL);
-    ap_rvputs(r, "ApacheServerName: ", 		ap_get_server_name(r), "\n", NULL);
-    ap_rprintf(r, "ApacheServerPort: %d\n", 		ap_get_server_port(r));
+    /* the keys of the keys= list, or all the keys. with the worker lines,
+     * the worker keys are counted by the walk of the lines */
+    rows = !query.keys && ctx.format == STATUS_TEXT_FORMAT_TEXT && query.worker_states;
+    needs = query.keys ? status_text_select_keys(&ctx, query.keys) : STATUS_TEXT_NEED_ALL;
+    if (needs) snap = status_text_get_snapshot(r, rows ? needs & ~(STATUS_TEXT_NEED_WORKERS|STATUS_TEXT_NEED_CPU)
+                                                      : needs);
+    ctx.snap = snap;
 
-    lr_count=0;
-    for (lr = ap_listeners; lr != NULL; lr = lr->next) 
+    if (ctx.format == STATUS_TEXT_FORMAT_PROMETHEUS)
     {
-       if (lr->active) 
+       status_text_print_prometheus(&ctx);
+       status_text_buf_flush(out);
+       return 0;
+    }
+    if (ctx.format == STATUS_TEXT_FORMAT_JSON)
+    {
+       status_text_print_json(&ctx);
+       status_text_buf_flush(out);
+       return 0;
+    }
+    if (ctx.format == STATUS_TEXT_FORMAT_BINARY)
+    {
+       status_text_print_binary(&ctx);
+       status_text_buf_flush(out);
+       return 0;
+    }
+    ctx.listing = query.keys == NULL;
+
+    /* delta scrapes: the full output publishes a snapshot, unless the
+     * worker lines are filtered or paged, and since= only prints the lines
+     * changed since a snapshot */
+    delta_workers = NULL;
+    delta_seq = 0;
+    delta_nb_old = delta_pos = delta_nb_new = 0;
+    old_hash = 0;
+    if (ctx.listing && status_text_delta && status_text_keys->nelts <= status_text_delta_keys)
+    {
+       if (query.child < 0 && query.min_duration == 0 && query.offset == 0 && query.limit < 0 &&
+           (query.worker_states == -1 || query.worker_states == 0))
        {
-                  if (lr->bind_addr->hostname)
-	 ap_rprintf(r, "ApacheListen[%d]: %s://%s:%d\n",
-	      lr_count,
-	      lr->protocol,
-	      lr->bind_addr->hostname,
-	      lr->bind_addr->port);
-                  else
-	 ap_rprintf(r, "ApacheListen[%d]: %s://%s:%d\n",
-	      lr_count,
-	      lr->protocol,
-	      "0.0.0.0",
-	      lr->bind_addr->port);
+          do delta_seq = apr_atomic_inc32(status_text_delta_seq) + 1; while (delta_seq == 0);
+          ctx.delta_new = apr_pcalloc(r->pool, sizeof(apr_uint64_t) *
+                                      (status_text_delta_keys + 2 * (apr_size_t)status_text_delta_lines));
+          apr_table_setn(r->headers_out, "X-Status-Text-Token",
+                         status_text_delta_token(r->pool, delta_seq));
        }
-       lr_count++;
-    }
+       if (query.since)
+       {
+          const char *reset;
 
-    ap_rvputs(r, "ApacheServerVersion: ", 	AP_SERVER_BASEVERSION " (" PLATFORM ")", "\n", NULL);
-    ap_rvputs(r, "ApacheServerBuilt: ", 	ap_get_server_built(), "\n", NULL);
-    ap_rvputs(r, "ApacheAprVersion: ", 	apr_version_string(), "\n", NULL);
-    ap_rvputs(r, "ApacheAprBuildVersion: ", 	APR_VERSION_STRING, "\n", NULL);
-    ap_rvputs(r, "ApacheApuVersion: ", 	apu_version_string(), "\n", NULL);
-    ap_rvputs(r, "ApacheApuBuildVersion: ", 	APU_VERSION_STRING, "\n", NULL);
-    ap_rprintf(r, "ApacheServerMPM: %s\n", ap_show_mpm());
-    ap_rprintf(r, "ApacheThreaded: %s\n",threaded ? "yes" : "no");
-    ap_rprintf(r, "ApacheForked: %s\n",forked ? "yes" : "no");
-    ap_rprintf(r, "ApacheServerArchitecture: %ld-bit\n",8 * (long) sizeof(void *));
-    ap_rprintf(r, "ApacheTimeout: %d\n", (int) (apr_time_sec(r->server->timeout)));
-    ap_rprintf(r, "ApacheKeepAliveTimeout: %d\n", (int) (apr_time_sec(r->server->keep_alive_timeout)));
-    ap_rprintf(r, "ApacheParentServerGeneration: %d\n", (int)ap_my_generation);
-    ap_rprintf(r, "ApacheCurrentTime: %"APR_TIME_T_FMT"\n", nowtime);
-    ap_rprintf(r, "ApacheRestartTime: %"APR_TIME_T_FMT"\n", ap_scoreboard_image->global->restart_time);
-    ap_rprintf(r, "ApacheServerUptime: %ld\n", (long) (up_time));
-
-    /* number of request per status code */
-    ap_rprintf(r, "Apache_NB_Reqs_xxx: %"APR_UINT64_T_FMT"\n", st_sb_total.nb_reqs_xxx);
-    ap_rprintf(r, "Apache_NB_Reqs_10x: %"APR_UINT64_T_FMT"\n", st_sb_total.nb_reqs_10x);
-    ap_rprintf(r, "Apache_NB_Reqs_200: %"APR_UINT64_T_FMT"\n", st_sb_total.nb_reqs_200);
-    ap_rprintf(r, "Apache_NB_Reqs_20x: %"APR_UINT64_T_FMT"\n", st_sb_total.nb_reqs_20x);
-    ap_rprintf(r, "Apache_NB_Reqs_301: %"APR_UINT64_T_FMT"\n", st_sb_total.nb_reqs_301);
-    ap_rprintf(r, "Apache_NB_Reqs_302: %"APR_UINT64_T_FMT"\n", st_sb_total.nb_reqs_302);
-    ap_rprintf(r, "Apache_NB_Reqs_304: %"APR_UINT64_T_FMT"\n", st_sb_total.nb_reqs_304);
-    ap_rprintf(r, "Apache_NB_Reqs_30x: %"APR_UINT64_T_FMT"\n", st_sb_total.nb_reqs_30x);
-    ap_rprintf(r, "Apache_NB_Reqs_404: %"APR_UINT64_T_FMT"\n", st_sb_total.nb_reqs_404);
-    ap_rprintf(r, "Apache_NB_Reqs_40x: %"APR_UINT64_T_FMT"\n", st_sb_total.nb_reqs_40x);
-    ap_rprintf(r, "Apache_NB_Reqs_50x: %"APR_UINT64_T_FMT"\n", st_sb_total.nb_reqs_50x);
-
-    /* number of bytes per status code */
-    ap_rprintf(r, "Apache_NB_Bytes_xxx: %" APR_UINT64_T_FMT "\n", st_sb_total.nb_bytes_xxx);
-    ap_rprintf(r, "Apache_NB_Bytes_10x: %" APR_UINT64_T_FMT "\n", st_sb_total.nb_bytes_10x);
-    ap_rprintf(r, "Apache_NB_Bytes_200: %" APR_UINT64_T_FMT "\n", st_sb_total.nb_bytes_200);
-    ap_rprintf(r, "Apache_NB_Bytes_20x: %" APR_UINT64_T_FMT "\n", st_sb_total.nb_bytes_20x);
-    ap_rprintf(r, "Apache_NB_Bytes_301: %" APR_UINT64_T_FMT "\n", st_sb_total.nb_bytes_301);
-    ap_rprintf(r, "Apache_NB_Bytes_302: %" APR_UINT64_T_FMT "\n", st_sb_total.nb_bytes_302);
-    ap_rprintf(r, "Apache_NB_Bytes_304: %" APR_UINT64_T_FMT "\n", st_sb_total.nb_bytes_304);
-    ap_rprintf(r, "Apache_NB_Bytes_30x: %" APR_UINT64_T_FMT "\n", st_sb_total.nb_bytes_30x);
-    ap_rprintf(r, "Apache_NB_Bytes_404: %" APR_UINT64_T_FMT "\n", st_sb_total.nb_bytes_404);
-    ap_rprintf(r, "Apache_NB_Bytes_40x: %" APR_UINT64_T_FMT "\n", st_sb_total.nb_bytes_40x);
-    ap_rprintf(r, "Apache_NB_Bytes_50x: %" APR_UINT64_T_FMT "\n", st_sb_total.nb_bytes_50x);
+          reset = status_text_delta_load(r->pool, query.since, &delta_old, &delta_workers, &delta_nb_old);
+          if (delta_seq)
+             status_text_buf_vputs(out, "Apache_Snapshot_Token: ",
+                                   apr_table_get(r->headers_out, "X-Status-Text-Token"), "\n", NULL);
+          status_text_buf_vputs(out, "Apache_Delta_Since: ", query.since, "\n", NULL);
+          if (reset) status_text_buf_vputs(out, "Apache_Delta_Reset: ", reset, "\n", NULL);
+          ctx.delta_old = delta_old;
+       }
+    }
 
-    /* number of request per response times range */
-    ap_rprintf(r, "Apache_NB_Reqs_50ms: %"APR_TIME_T_FMT"\n", st_sb_total.nb_reqs_50ms);
-    ap_rprintf(r, "Apache_NB_Reqs_100ms: %"APR_TIME_T_FMT"\n", st_sb_total.nb_reqs_100ms);
-    ap_rprintf(r, "Apache_NB_Reqs_300ms: %"APR_TIME_T_FMT"\n", st_sb_total.nb_reqs_300ms);
-    ap_rprintf(r, "Apache_NB_Reqs_500ms: %"APR_TIME_T_FMT"\n", st_sb_total.nb_reqs_500ms);
-    ap_rprintf(r, "Apache_NB_Reqs_1s: %"APR_TIME_T_FMT"\n", st_sb_total.nb_reqs_1s);
-    ap_rprintf(r, "Apache_NB_Reqs_1_5s: %"APR_TIME_T_FMT"\n", st_sb_total.nb_reqs_1_5s);
-    ap_rprintf(r, "Apache_NB_Reqs_2s: %"APR_TIME_T_FMT"\n", st_sb_total.nb_reqs_2s);
-    ap_rprintf(r, "Apache_NB_Reqs_5s: %"APR_TIME_T_FMT"\n", st_sb_total.nb_reqs_5s);
-    ap_rprintf(r, "Apache_NB_Reqs_10s: %"APR_TIME_T_FMT"\n", st_sb_total.nb_reqs_10s);
-    ap_rprintf(r, "Apache_NB_Reqs_15s: %"APR_TIME_T_FMT"\n", st_sb_total.nb_reqs_15s);
-    ap_rprintf(r, "Apache_NB_Reqs_20s: %"APR_TIME_T_FMT"\n", st_sb_total.nb_reqs_20s);
-    ap_rprintf(r, "Apache_NB_Reqs_30s: %"APR_TIME_T_FMT"\n", st_sb_total.nb_reqs_30s);
-    ap_rprintf(r, "Apache_NB_Reqs_xs: %"APR_TIME_T_FMT"\n", st_sb_total.nb_reqs_xs);
-
-    ap_rprintf(r, "Apache_Avg_ResponseTime: %"APR_TIME_T_FMT"\n", st_sb_total.avg);
-    ap_rprintf(r, "Apache_Percentil_Array:%"APR_TIME_T_FMT"", percentil_array[0]);
-    for(i=1;i<nb_percentil;i++)
-    ap_rprintf(r, ",%"APR_TIME_T_FMT"", percentil_array[i]);
-    ap_rprintf(r, "\n");
-    
-    ap_rprintf(r, "Apache_90Percentil_ResponseTime: %"APR_TIME_T_FMT"\n", st_sb_total.percentil);
-
-    ap_rprintf(r, "ApacheTotalAccesses: %"APR_UINT64_T_FMT"\n", count);
-    ap_rprintf(r, "ApacheTotalKBytes: %" APR_UINT64_T_FMT "\n", kbcount);
-
-    ap_rprintf(r, "ApacheThreadLimit: %u\n", thread_limit);
-    ap_rprintf(r, "ApacheServerLimit: %u\n", server_limit);
-    ap_rprintf(r, "ApacheMaxWorker: %d\n",max_daemons);
-    ap_rprintf(r, "ApacheBusyWorkers: %d\n", busy);
-    ap_rprintf(r, "ApacheIdleWorkers: %d\n", ready);
+    if (!rows) 
+    {
+       status_text_print_text(&ctx);
+       if (ctx.delta_new) status_text_delta_publish(delta_seq, ctx.delta_new, 0, 0);
+       status_text_buf_flush(out);
+       return 0;
+    }
 
-#ifdef HAVE_TIMES
-    ap_rprintf(r, "ApacheCPUUsage.User: %g\n", tu / tick);
-    ap_rprintf(r, "ApacheCPUUsage.System: %g\n", ts / tick);
-    ap_rprintf(r, "ApacheChildCPUUsage.User: %g\n", tcu / tick);
-    ap_rprintf(r, "ApacheChildCPUUsage.System: %g\n", tcs / tick);
-
-    if (ts || tu || tcu || tcs)
-	ap_rprintf(r, "ApacheCPULoad: %g\n",
-		   (tu + ts + tcu + tcs) / tick / up_time * 100.);
-#endif
+    /* send the scoreboard 'table' out, in its own buffer sent after the
+     * keys: a single walk of the workers in use counts the worker keys and
+     * prints the lines */
+    status_text_buf_init(lines, r, STATUS_TEXT_BUF_SIZE);
+    snap->needs |= STATUS_TEXT_NEED_WORKERS|STATUS_TEXT_NEED_CPU;
+    snap->ready = snap->busy = 0;
+    snap->count = snap->kbcount = 0;
+    snap->tu = snap->ts = snap->tcu = snap->tcs = 0;
+    bcount = 0;
+    st_sb_cur = apr_palloc(r->pool, sizeof(status_text_scoreboard_t));
+    worker_hist = apr_palloc(r->pool, STATUS_TEXT_HIST_BUCKETS * sizeof(double));
+    monotonic_now = status_text_monotonic_now();
 
-    /* send the scoreboard 'table' out */
     /*
      ap_rputs("#ApacheWorker[ServIndx-ServGen]: Pid;Acc;Status;CPU;SrvTime;ReqTime;Conn;Client;Request\n",r);
      */
 
+    /* lines matching the filters of the query, from offset to limit */
+    matched = 0;
     for (i = 0; i < server_limit; ++i) 
     {
-	for (j = 0; j < thread_limit; ++j) 
+	ps_record = ap_get_scoreboard_process(i);
+	nb = status_text_walk_limit(i, ps_record, &marked_only);
+	memset(&proc, 0, sizeof(proc));
+	block = -2; /* looked up at the first line of the child */
+	for (j = 0; j < nb; ++j) 
 	{
             int indx = (i * thread_limit) + j;
 
-	    /* get the current status text scoreboard */
-	    st_sb_cur=&st_sb[indx];
+	    /* delta: the lines of the since= snapshot not walked are gone */
+	    if (delta_workers)
+		status_text_delta_removed(lines, delta_workers, delta_nb_old, &delta_pos, indx, query.child);
 
+	    if (marked_only && !status_text_worker_marked(i, j))
+		empty = 1;
+	    else {
 	    #if AP_MODULE_MAGIC_AT_LEAST(20051005,0)
               ap_copy_scoreboard_worker(&ws_record_st,i, j);
 	    #else
 	      ws_record = ap_get_scoreboard_worker(i, j);
             #endif
-
-	    if (ws_record->access_count == 0 &&
-		(ws_record->status == SERVER_READY ||
-		 ws_record->status == SERVER_DEAD)) 
+		status_text_count_worker(snap, ps_record, ws_record, ap_my_generation, &proc, &bcount);
+		empty = ws_record->access_count == 0 &&
+		    (ws_record->status == SERVER_READY ||
+		     ws_record->status == SERVER_DEAD);
+	    }
+	    if (empty) 
+	    {
+		/* delta: the line of the snapshot is gone */
+		if (delta_workers)
+		    status_text_delta_removed(lines, delta_workers, delta_nb_old, &delta_pos,
+					      (apr_uint64_t)indx + 1, query.child);
+		continue;
+	    }
+	    if (delta_workers)
+	    {
+		old_hash = 0;
+		if (delta_pos < delta_nb_old && delta_workers[2 * delta_pos] == (apr_uint64_t)indx)
+		    old_hash = delta_workers[2 * delta_pos++ + 1];
+	    }
+	    if ((query.child >= 0 && i != query.child) ||
+		!(query.worker_states & STATUS_TEXT_STATE(ws_record->status)))
 		     continue;
 
-	    ps_record = ap_get_scoreboard_process(i);
-
 	    if (ws_record->start_time == 0L)
 		req_time = 0L;
 	    else
@@ -1141,6 +3511,38 @@ static int status_text_handler(request_rec *r)
 		      ws_record->start_time) / 1000);
 	    if (req_time < 0L)
 		req_time = 0L;
+	    if (query.min_duration > 0) {
+		/* a request in progress lasts since its start */
+		apr_time_t duration = (apr_time_t)req_time * 1000;
+		if (ws_record->start_time != 0L &&
+		    ws_record->stop_time < ws_record->start_time)
+		    duration = nowtime - ws_record->start_time;
+		if (duration < query.min_duration)
+		     continue;
+	    }
+
+	    /* pagination, the walk goes on for the worker keys */
+	    if (matched++ < query.offset)
+		     continue;
+	    if (query.limit >= 0 && matched > query.offset + query.limit)
+		     continue;
+
+	    /* get a consistent copy of the slot of the worker, if it has one
+	     * (the slot of a child is not the one of its workers) */
+	    if (block == -2)
+		block = status_text_find_block(ps_record->pid);
+	    if (block >= 0 && j < status_text_threads &&
+		status_text_granularity == STATUS_TEXT_GRANULARITY_THREAD)
+		status_text_read_slot(st_sb_cur,&st_sb_cold,block * status_text_threads + j,
+				      sizeof(status_text_scoreboard_t));
+	    else {
+		memset(st_sb_cur,0,sizeof(status_text_scoreboard_t));
+		st_sb_cold.max = 0;
+	    }
+
+	    /* 1 minute sliding window of the worker */
+	    memset(worker_hist,0,STATUS_TEXT_HIST_BUCKETS * sizeof(double));
+	    status_text_window_merge(worker_hist,st_sb_cur,STATUS_TEXT_DEFAULT_WINDOW,monotonic_now);
 
 	    lres = ws_record->access_count;
 	    my_lres = ws_record->my_access_count;
@@ -1157,169 +3559,679 @@ static int status_text_handler(request_rec *r)
 		worker_generation = ps_record->generation;
 	    }
 
+	    /* delta: the line may be dropped if it did not change */
+	    if (ctx.delta_new || delta_workers) status_text_buf_mark(lines);
+
+	    status_text_buf_puts(lines, "ApacheWorker[");
+	    status_text_buf_i64(lines, i);
+	    status_text_buf_putc(lines, '-');
+	    status_text_buf_i64(lines, j);
+	    status_text_buf_putc(lines, '-');
+	    status_text_buf_i64(lines, (int)worker_generation);
+	    status_text_buf_puts(lines, "]: ");
 	    if (ws_record->status == SERVER_DEAD)
-		ap_rprintf(r, "ApacheWorker[%d-%d-%d]: -;%d|%" APR_UINT64_T_FMT "|%" APR_UINT64_T_FMT ";",
-			   i, j, (int)worker_generation,
-			   (int)conn_lres, my_lres, lres);
+		status_text_buf_putc(lines, '-');
 	    else
-		ap_rprintf(r, "ApacheWorker[%d-%d-%d]: %"
-			   APR_PID_T_FMT ";%d|%" APR_UINT64_T_FMT "|%" APR_UINT64_T_FMT ";",
-			   i, j, (int) worker_generation,
-			   worker_pid,
-			   (int)conn_lres, my_lres, lres);
+		status_text_buf_i64(lines, worker_pid);
+	    status_text_buf_putc(lines, ';');
+	    status_text_buf_i64(lines, (int)conn_lres);
+	    status_text_buf_putc(lines, '|');
+	    status_text_buf_u64(lines, my_lres);
+	    status_text_buf_putc(lines, '|');
+	    status_text_buf_u64(lines, lres);
+	    status_text_buf_putc(lines, ';');
+
+	    switch (ws_record->status) 
+	    {
+	      case SERVER_READY:
+		  status_text_buf_puts(lines, "Ready");
+		  break;
+	      case SERVER_STARTING:
+		  status_text_buf_puts(lines, "Starting");
+		  break;
+	      case SERVER_BUSY_READ:
+		  status_text_buf_puts(lines, "Read");
+		  break;
+	      case SERVER_BUSY_WRITE:
+		  status_text_buf_puts(lines, "Write");
+		  break;
+	      case SERVER_BUSY_KEEPALIVE:
+		  status_text_buf_puts(lines, "Keepalive");
+		  break;
+	      case SERVER_BUSY_LOG:
+		  status_text_buf_puts(lines, "Logging>");
+		  break;
+	      case SERVER_BUSY_DNS:
+		  status_text_buf_puts(lines, "DNS lookup");
+		  break;
+	      case SERVER_CLOSING:
+		  status_text_buf_puts(lines, "Closing");
+		  break;
+	      case SERVER_DEAD:
+		  status_text_buf_puts(lines, "Dead");
+		  break;
+	      case SERVER_GRACEFUL:
+		  status_text_buf_puts(lines, "Graceful");
+		  break;
+	      case SERVER_IDLE_KILL:
+		  status_text_buf_puts(lines, "Dying");
+		  break;
+	      default:
+		  status_text_buf_puts(lines, "?STATE?");
+		  break;
+	    }
+
+#ifdef HAVE_TIMES
+	    status_text_buf_printf(lines, ";%g|%g|%g|%g",
+		       ws_record->times.tms_utime / tick,
+		       ws_record->times.tms_stime / tick,
+		       ws_record->times.tms_cutime / tick,
+		       ws_record->times.tms_cstime / tick);
+#else
+	    status_text_buf_puts(lines,  ";-|-|-|-");
+#endif
+
+	    status_text_buf_putc(lines, ';');
+	    row_skip_start = lines->len - lines->mark;
+	    status_text_buf_i64(lines, (long) apr_time_sec(nowtime - ws_record->last_used));
+	    row_skip_end = lines->len - lines->mark;
+	    if (status_text_granularity == STATUS_TEXT_GRANULARITY_PROCESS)
+		status_text_buf_puts(lines, ";-;-;-;");
+	    else {
+		status_text_buf_putc(lines, ';');
+		status_text_buf_fixed3(lines, STATUS_TEXT_MSEC(st_sb_cur->last));
+		status_text_buf_putc(lines, ';');
+		status_text_buf_fixed3(lines, STATUS_TEXT_MSEC(STATUS_TEXT_EWMA_TIME(st_sb_cur->ewma[0])));
+		status_text_buf_putc(lines, ';');
+		status_text_buf_fixed3(lines, STATUS_TEXT_MSEC(status_text_window_percentile(worker_hist,
+						       900, st_sb_cold.max)));
+		status_text_buf_putc(lines, ';');
+	    }
+	    status_text_buf_i64(lines, req_time);
+
+	    status_text_buf_putc(lines, ';');
+	    status_text_buf_u64(lines, conn_bytes);
+	    status_text_buf_putc(lines, '|');
+	    status_text_buf_u64(lines, my_bytes);
+	    status_text_buf_putc(lines, '|');
+	    status_text_buf_u64(lines, bytes);
+
+	    /* client, request and vhost escaped in a single pass */
+	    status_text_buf_putc(lines, ';');
+	    status_text_buf_escaped(lines, ws_record->client, 0);
+	    status_text_buf_putc(lines, '|');
+	    status_text_buf_escaped(lines, ws_record->request, 1);
+	    status_text_buf_putc(lines, '|');
+	    status_text_buf_escaped(lines, ws_record->vhost, 0);
+
+	    /* delta: the line changed if its hash, without the seconds since
+	     * the last request, changed */
+	    if (lines->mark != STATUS_TEXT_BUF_NO_MARK)
+	    {
+		row_hash = status_text_fnv(STATUS_TEXT_FNV_INIT, lines->buf + lines->mark, row_skip_start);
+		row_hash = status_text_fnv(row_hash, lines->buf + lines->mark + row_skip_end,
+					   lines->len - lines->mark - row_skip_end) | 1;
+		if (ctx.delta_new && delta_nb_new < status_text_delta_lines)
+		{
+		    ctx.delta_new[status_text_delta_keys + 2 * delta_nb_new] = indx;
+		    ctx.delta_new[status_text_delta_keys + 2 * delta_nb_new + 1] = row_hash;
+		}
+		if (ctx.delta_new) ++delta_nb_new;
+		if (delta_workers && old_hash == row_hash)
+		{
+		    status_text_buf_rollback(lines);
+		    continue;
+		}
+		status_text_buf_unmark(lines);
+	    }
+	    status_text_buf_putc(lines, '\n');
+	} /* for (j...) */
+	status_text_count_process(snap, &proc);
+    } /* for (i...) */
+
+    if (delta_workers)
+	status_text_delta_removed(lines, delta_workers, delta_nb_old, &delta_pos,
+				  (apr_uint64_t)server_limit * thread_limit, query.child);
+
+    /* the keys, then the lines (without the worker lines values when they
+     * do not fit in the entry) */
+    status_text_print_text(&ctx);
+    if (ctx.delta_new)
+	status_text_delta_publish(delta_seq, ctx.delta_new, delta_nb_new <= status_text_delta_lines,
+				  delta_nb_new <= status_text_delta_lines ? delta_nb_new : 0);
+    status_text_buf_flush(out);
+    status_text_buf_flush(lines);
+    return 0;
+}
+
+void status_text_log_listen(apr_pool_t *p, server_rec*s, const char *filename)
+{
+    int lr_count=0;
+    ap_listen_rec *lr=NULL;
+    apr_file_t *listen_file = NULL;
+    apr_status_t rv;
+    const char *fname;
+
+    if (!filename) {
+        return;
+    }
+
+    fname = ap_server_root_relative(p, filename);
+    if (!fname) {
+        ap_log_error(APLOG_MARK, APLOG_STARTUP|APLOG_CRIT, APR_EBADPATH,
+                     NULL, "Invalid PID file path %s, ignoring.", filename);
+        return;
+    }
+
+    core_server_config *conf;
+    conf = (core_server_config *)ap_get_module_config(s->module_config,
+							  &core_module);
+
+    if ((rv = apr_file_open(&listen_file, fname,
+                            APR_WRITE | APR_CREATE | APR_TRUNCATE,
+                            APR_UREAD | APR_UWRITE | APR_GREAD | APR_WREAD, p))
+        != APR_SUCCESS) {
+        ap_log_error(APLOG_MARK, APLOG_ERR, rv, NULL,
+                     "could not create %s", fname);
+        ap_log_error(APLOG_MARK, APLOG_ERR, 0, NULL,
+                     "%s: could not log listen information to file %s",
+                     ap_server_argv0, fname);
+        exit(1);
+    }
+    apr_file_printf(listen_file, "ApacheServerRoot: %s\n",ap_server_root);
+    apr_file_printf(listen_file, "ApacheServerDocumentRoot: %s\n",conf->ap_document_root);
+
+    lr_count=0;
+    for (lr = ap_listeners; lr != NULL; lr = lr->next) 
+    {
+       lr_count++;
+       if (lr->active) 
+       {
+         if (lr->bind_addr->hostname)
+	 apr_file_printf(listen_file, "ApacheListen[%d]: %s://%s:%d\n",
+	      lr_count,
+	      lr->protocol,
+	      lr->bind_addr->hostname,
+	      lr->bind_addr->port);
+         else
+	 apr_file_printf(listen_file, "ApacheListen[%d]: %s://%s:%d\n",
+	      lr_count,
+	      lr->protocol,
+	      "0.0.0.0",
+	      lr->bind_addr->port);
+       }
+    }
+    apr_file_close(listen_file);
+}
+
+/* helper process forked by the parent (see status_text_start_helper), for
+ * the background aggregator (StatusTextAggregateInterval) and the push
+ * (StatusTextPush). it runs outside of the workers, so it keeps going when
+ * they are all busy and the scrapes time out.
+ *
+ * StatusTextPush: the statistics keys are pushed every
+ * StatusTextPushInterval to a local StatsD agent, as "key:value|g" lines
+ * (the counters as "key:increment|c") batched in datagrams of at most
+ * StatusTextPushPacketSize bytes.
+ */
+#define STATUS_TEXT_PUSH_DEFAULT_INTERVAL apr_time_from_sec(10)
+#define STATUS_TEXT_PUSH_DEFAULT_PACKET   1432  /* one ethernet frame */
+#define STATUS_TEXT_PUSH_MAX_PACKET       65507 /* largest udp payload */
+
+static const char *status_text_push = NULL; /* udp://host:port or unix:/path */
+static apr_interval_time_t status_text_push_interval;
+static int status_text_push_packet;
+static apr_proc_t *status_text_helper_proc = NULL;
+
+/* state of the push */
+typedef struct {
+    apr_socket_t *sock;
+    apr_sockaddr_t *sa;
+    double *last;   /* counter values of the last push, by key index */
+    char *packet;
+    int first;      /* first push: only the counter values are taken */
+} status_text_push_t;
+
+/* socket and address of the StatusTextPush target, NULL on error */
+static status_text_push_t *status_text_push_open(apr_pool_t *p)
+{
+    status_text_push_t *push = apr_pcalloc(p, sizeof(status_text_push_t));
+    char *host, *scope;
+    apr_port_t port;
+    apr_status_t rv;
+
+#if APR_HAVE_SOCKADDR_UN
+    if (strncmp(status_text_push, "unix:", 5) == 0) {
+        rv = apr_sockaddr_info_get(&push->sa, status_text_push + 5, APR_UNIX, 0, 0, p);
+        if (rv == APR_SUCCESS)
+            rv = apr_socket_create(&push->sock, APR_UNIX, SOCK_DGRAM, 0, p);
+    }
+    else
+#endif
+    {
+        rv = apr_parse_addr_port(&host, &scope, &port, status_text_push + 6, p);
+        if (rv == APR_SUCCESS && (host == NULL || port == 0))
+            rv = APR_EINVAL;
+        if (rv == APR_SUCCESS)
+            rv = apr_sockaddr_info_get(&push->sa, host, APR_UNSPEC, port, 0, p);
+        if (rv == APR_SUCCESS)
+            rv = apr_socket_create(&push->sock, push->sa->family, SOCK_DGRAM, APR_PROTO_UDP, p);
+    }
+    if (rv != APR_SUCCESS) {
+        ap_log_error(APLOG_MARK, APLOG_ERR, rv, NULL, "StatusTextPush: can't open %s", status_text_push);
+        return NULL;
+    }
+    push->last = apr_pcalloc(p, sizeof(double) * status_text_keys->nelts);
+    push->packet = apr_palloc(p, status_text_push_packet);
+    push->first = 1;
+    return push;
+}
+
+static void status_text_push_send(status_text_push_t *push, apr_size_t len)
+{
+    apr_status_t rv;
+
+    if (len == 0) return;
+    rv = apr_socket_sendto(push->sock, push->sa, 0, push->packet, &len);
+    if (rv != APR_SUCCESS)
+        ap_log_error(APLOG_MARK, APLOG_DEBUG, rv, NULL, "StatusTextPush: can't send to %s", status_text_push);
+}
+
+/* push the statistics keys of a snapshot, in packets of whole lines */
+static void status_text_push_snapshot(status_text_push_t *push, const status_text_snapshot_t *snap)
+{
+    status_text_ctx_t ctx;
+    const status_text_key_t *key;
+    double value, delta;
+    char line[256];
+    apr_size_t len = 0, n;
+    int i;
+
+    memset(&ctx, 0, sizeof(ctx));
+    ctx.snap = snap;
+    ctx.nowtime = apr_time_now();
+#ifdef HAVE_TIMES
+#ifdef _SC_CLK_TCK
+    ctx.tick = sysconf(_SC_CLK_TCK);
+#else
+    ctx.tick = HZ;
+#endif
+#endif
+
+    for (i = 0; i < status_text_keys->nelts; ++i) {
+        key = STATUS_TEXT_KEY(i);
+        if (key->needs == 0 || (key->needs & ~snap->needs) || (key->needs & STATUS_TEXT_NEED_CPU) ||
+            (key->flags & (STATUS_TEXT_KEY_QUERY_ONLY|STATUS_TEXT_KEY_ALIAS)) ||
+            (key->type != STATUS_TEXT_TYPE_GAUGE && key->type != STATUS_TEXT_TYPE_COUNTER) ||
+            ((key->flags & STATUS_TEXT_KEY_OPTIONAL) && !status_text_key_present(&ctx, key)) ||
+            !status_text_key_number(&ctx, key, &value))
+            continue;
+        if (key->type == STATUS_TEXT_TYPE_COUNTER) {
+            /* increment since the last push, the first push only takes
+             * the starting values */
+            delta = value >= push->last[i] ? value - push->last[i] : value;
+            push->last[i] = value;
+            if (push->first || delta == 0)
+                continue;
+            n = apr_snprintf(line, sizeof(line), "%s:%.15g|c\n", key->name, delta);
+        }
+        else
+            n = apr_snprintf(line, sizeof(line), "%s:%.15g|g\n", key->name, value);
+        if (len + n > (apr_size_t)status_text_push_packet) {
+            status_text_push_send(push, len);
+            len = 0;
+        }
+        if (n <= (apr_size_t)status_text_push_packet) {
+            memcpy(push->packet + len, line, n);
+            len += n;
+        }
+    }
+    status_text_push_send(push, len);
+    push->first = 0;
+}
+
+/* StatusTextCheckpointFile: the helper saves the counters of the status
+ * text scoreboard every StatusTextCheckpointInterval and when it is
+ * stopped, they are loaded in the first block of the segment at startup so
+ * they survive a full restart (see status_text_checkpoint_load). the moving
+ * averages, windows and time series follow the monotonic clock, they are
+ * not saved. the file is in the server byte order. */
+#define STATUS_TEXT_CHECKPOINT_MAGIC            "STXC"
+#define STATUS_TEXT_CHECKPOINT_VERSION          1
+#define STATUS_TEXT_CHECKPOINT_DEFAULT_INTERVAL apr_time_from_sec(60)
+
+typedef struct {
+    char magic[4];           /* STATUS_TEXT_CHECKPOINT_MAGIC */
+    apr_uint32_t version;    /* STATUS_TEXT_CHECKPOINT_VERSION */
+    apr_uint32_t size;       /* sizeof(status_text_checkpoint_t) */
+    apr_uint32_t nb_latency; /* response time ranges of the counters */
+    apr_time_t save_time;
+    apr_time_t latency_bounds[STATUS_TEXT_MAX_LATENCY_BUCKETS];
+    status_text_code_count_t codes[STATUS_TEXT_NB_CODES];
+    apr_uint64_t nb_reqs_latency[STATUS_TEXT_MAX_LATENCY_BUCKETS];
+    apr_uint64_t hist[STATUS_TEXT_HIST_BUCKETS];
+    apr_uint64_t time_sum;
+    apr_time_t max;
+} status_text_checkpoint_t;
+
+static const char *status_text_checkpoint_file = NULL;
+static apr_interval_time_t status_text_checkpoint_interval;
+static volatile sig_atomic_t status_text_helper_stop = 0; /* SIGTERM received */
+
+/* write the counters of a snapshot to the checkpoint file, under a
+ * temporary name renamed once written */
+static void status_text_checkpoint_save(apr_pool_t *p, const status_text_snapshot_t *snap)
+{
+    static int failed = 0;
+    status_text_checkpoint_t *c = apr_pcalloc(p, sizeof(status_text_checkpoint_t));
+    const char *tmp = apr_pstrcat(p, status_text_checkpoint_file, ".tmp", NULL);
+    apr_file_t *file;
+    apr_status_t rv;
+
+    memcpy(c->magic, STATUS_TEXT_CHECKPOINT_MAGIC, 4);
+    c->version = STATUS_TEXT_CHECKPOINT_VERSION;
+    c->size = sizeof(status_text_checkpoint_t);
+    c->nb_latency = status_text_nb_latency_buckets;
+    c->save_time = apr_time_now();
+    memcpy(c->latency_bounds, status_text_latency_bounds, sizeof(c->latency_bounds));
+    memcpy(c->codes, snap->codes, sizeof(c->codes));
+    memcpy(c->nb_reqs_latency, snap->nb_reqs_latency, sizeof(c->nb_reqs_latency));
+    memcpy(c->hist, snap->hist, sizeof(c->hist));
+    c->time_sum = snap->time_sum;
+    c->max = snap->max_response_time;
+
+    rv = apr_file_open(&file, tmp, APR_WRITE | APR_CREATE | APR_TRUNCATE | APR_BINARY,
+                       APR_UREAD | APR_UWRITE, p);
+    if (rv == APR_SUCCESS) {
+        rv = apr_file_write_full(file, c, sizeof(status_text_checkpoint_t), NULL);
+        if (apr_file_close(file) != APR_SUCCESS && rv == APR_SUCCESS)
+            rv = APR_EGENERAL;
+        if (rv == APR_SUCCESS)
+            rv = apr_file_rename(tmp, status_text_checkpoint_file, p);
+    }
+    /* once per failure streak, the helper runs as the User */
+    if (rv != APR_SUCCESS && !failed)
+        ap_log_error(APLOG_MARK, APLOG_WARNING, rv, NULL,
+                     "mod_status_text: can't write the checkpoint file \"%s\"", status_text_checkpoint_file);
+    failed = rv != APR_SUCCESS;
+}
+
+/* add the counters of the checkpoint file to the totals of the first block
+ * of a new segment, the response time ranges counters only when the ranges
+ * are the same */
+static void status_text_checkpoint_load(apr_pool_t *p)
+{
+    status_text_checkpoint_t c;
+    status_text_block_t *blk = STATUS_TEXT_BLOCK(0);
+    apr_file_t *file;
+    apr_status_t rv;
+    int k;
+
+    if (apr_file_open(&file, status_text_checkpoint_file, APR_READ | APR_BINARY, APR_OS_DEFAULT, p) != APR_SUCCESS)
+        return; /* no checkpoint yet */
+    rv = apr_file_read_full(file, &c, sizeof(c), NULL);
+    apr_file_close(file);
+    if (rv != APR_SUCCESS || memcmp(c.magic, STATUS_TEXT_CHECKPOINT_MAGIC, 4) != 0 ||
+        c.version != STATUS_TEXT_CHECKPOINT_VERSION || c.size != sizeof(c)) {
+        ap_log_error(APLOG_MARK, APLOG_WARNING, rv, NULL,
+                     "mod_status_text: invalid checkpoint file \"%s\", ignored", status_text_checkpoint_file);
+        return;
+    }
+
+    for (k = 0; k < STATUS_TEXT_NB_CODES; ++k) {
+        blk->codes[k].reqs += c.codes[k].reqs;
+        blk->codes[k].bytes += c.codes[k].bytes;
+    }
+    if (c.nb_latency == (apr_uint32_t)status_text_nb_latency_buckets &&
+        memcmp(c.latency_bounds, status_text_latency_bounds, sizeof(c.latency_bounds)) == 0)
+        for (k = 0; k < status_text_nb_latency_buckets; ++k)
+            blk->nb_reqs_latency[k] += c.nb_reqs_latency[k];
+    for (k = 0; k < STATUS_TEXT_HIST_BUCKETS; ++k)
+        blk->hist[k] += c.hist[k];
+    blk->time_sum += c.time_sum;
+    if (c.max > blk->max)
+        blk->max = c.max;
+    blk->used = 1;
+    ap_log_error(APLOG_MARK, APLOG_INFO, 0, NULL,
+                 "mod_status_text: counters loaded from \"%s\"", status_text_checkpoint_file);
+}
+
+static void status_text_helper_term(int sig)
+{
+    status_text_helper_stop = 1;
+}
+
+/* aggregate a snapshot in the aggregator buffer of the next sequence
+ * number and publish it (the helper is the only writer) */
+static status_text_snapshot_t *status_text_agg_publish(apr_pool_t *p, int needs)
+{
+    apr_uint32_t seq = status_text_agg->seq + 1;
+    status_text_snapshot_t *snap;
+
+    if (seq == 0) seq = 1;
+    snap = STATUS_TEXT_AGG_BUFFER(seq & 1);
+    status_text_agg->writing = seq;
+    STATUS_TEXT_WRITE_BARRIER();
+    status_text_aggregate(snap, p, needs);
+    STATUS_TEXT_WRITE_BARRIER();
+    status_text_agg->seq = seq;
+    return snap;
+}
 
-	    switch (ws_record->status) 
-	    {
-	      case SERVER_READY:
-		  ap_rputs("Ready", r);
-		  break;
-	      case SERVER_STARTING:
-		  ap_rputs("Starting", r);
-		  break;
-	      case SERVER_BUSY_READ:
-		  ap_rputs("Read", r);
-		  break;
-	      case SERVER_BUSY_WRITE:
-		  ap_rputs("Write", r);
-		  break;
-	      case SERVER_BUSY_KEEPALIVE:
-		  ap_rputs("Keepalive", r);
-		  break;
-	      case SERVER_BUSY_LOG:
-		  ap_rputs("Logging>", r);
-		  break;
-	      case SERVER_BUSY_DNS:
-		  ap_rputs("DNS lookup", r);
-		  break;
-	      case SERVER_CLOSING:
-		  ap_rputs("Closing", r);
-		  break;
-	      case SERVER_DEAD:
-		  ap_rputs("Dead", r);
-		  break;
-	      case SERVER_GRACEFUL:
-		  ap_rputs("Graceful", r);
-		  break;
-	      case SERVER_IDLE_KILL:
-		  ap_rputs("Dying", r);
-		  break;
-	      default:
-		  ap_rputs("?STATE?", r);
-		  break;
-	    }
+/* main loop of the helper, until the parent is gone or it is stopped */
+static void status_text_helper_loop(apr_pool_t *p, pid_t parent)
+{
+    apr_pool_t *ptemp;
+    status_text_push_t *push = NULL;
+    status_text_snapshot_t *snap = NULL;
+    apr_interval_time_t tick;
+    apr_time_t now, next, next_push, next_checkpoint;
+    int fresh;
+    /* the apache scoreboard is created before, see register_hooks */
+    int needs = ap_exists_scoreboard_image() ? STATUS_TEXT_NEED_ALL :
+                STATUS_TEXT_NEED_SLOTS|STATUS_TEXT_NEED_PERCENTILS|STATUS_TEXT_NEED_SERIES;
 
 #ifdef HAVE_TIMES
-	    ap_rprintf(r, ";%g|%g|%g|%g",
-		       ws_record->times.tms_utime / tick,
-		       ws_record->times.tms_stime / tick,
-		       ws_record->times.tms_cutime / tick,
-		       ws_record->times.tms_cstime / tick);
-#else
-	    ap_rputs( ";-|-|-|-", r);
+    child_pid = getpid();
 #endif
+    if (status_text_push && (push = status_text_push_open(p)) == NULL &&
+        status_text_agg == NULL && status_text_checkpoint_file == NULL)
+        return;
+    apr_pool_create(&ptemp, p);
+    if (status_text_agg == NULL)
+        snap = apr_palloc(p, STATUS_TEXT_SNAPSHOT_SIZE);
+    /* the shortest of the intervals in use */
+    tick = status_text_agg ? status_text_agg_interval : APR_INT64_MAX;
+    if (push && status_text_push_interval < tick)
+        tick = status_text_push_interval;
+    if (status_text_checkpoint_file && status_text_checkpoint_interval < tick)
+        tick = status_text_checkpoint_interval;
 
-	    ap_rprintf(r, ";%ld;%"APR_TIME_T_FMT";%"APR_TIME_T_FMT";%"APR_TIME_T_FMT";%ld",
-		       (long) apr_time_sec(nowtime -
-					  ws_record->last_used),
-		       st_sb_cur->last,
-		       st_sb_cur->avg,
-		       st_sb_cur->percentil,
-		       req_time);
-
-	    ap_rprintf(r, ";%"APR_UINT64_T_FMT"|%"APR_UINT64_T_FMT"|%" APR_UINT64_T_FMT ,  
-			  conn_bytes, 
-			  my_bytes , 
-			  bytes);
-
-	    ap_rprintf(r,
-		       ";%s|%s|%s\n",
-		       ap_escape_html(r->pool,
-				      ws_record->client),
-		       ap_escape_html(r->pool,
-				      ap_escape_logitem(r->pool,
-							ws_record->request)),
-		       ap_escape_html(r->pool,
-				      ws_record->vhost));
-	} /* for (j...) */
-    } /* for (i...) */
+    next = next_push = next_checkpoint = status_text_monotonic_now();
+    for (;;) {
+        next += tick;
+        now = status_text_monotonic_now();
+        if (next > now && !status_text_helper_stop)
+            apr_sleep(next - now); /* interrupted by SIGTERM */
+        else
+            next = now; /* late, no catch up */
+        if (getppid() != parent)
+            return;
+        apr_pool_clear(ptemp);
 
-    return 0;
+        fresh = 0;
+        if (status_text_agg) {
+            snap = status_text_agg_publish(ptemp, needs);
+            fresh = 1;
+        }
+        if (push && next >= next_push && !status_text_helper_stop) {
+            if (!fresh)
+                status_text_aggregate(snap, ptemp, needs);
+            fresh = 1;
+            status_text_push_snapshot(push, snap);
+            next_push = next + status_text_push_interval;
+        }
+        if (status_text_checkpoint_file && (next >= next_checkpoint || status_text_helper_stop)) {
+            if (!fresh)
+                status_text_aggregate(snap, ptemp, needs);
+            status_text_checkpoint_save(ptemp, snap);
+            next_checkpoint = next + status_text_checkpoint_interval;
+        }
+        if (status_text_helper_stop)
+            return;
+    }
 }
 
-void status_text_log_listen(apr_pool_t *p, server_rec*s, const char *filename)
+/* fork the helper, after stopping the one of the previous scoreboard */
+static void status_text_start_helper(apr_pool_t *p)
 {
-    int lr_count=0;
-    ap_listen_rec *lr=NULL;
-    apr_file_t *listen_file = NULL;
+    apr_proc_t *proc;
+    pid_t parent = getpid();
     apr_status_t rv;
-    const char *fname;
 
-    if (!filename) {
-        return;
+    if (status_text_helper_proc) {
+        apr_proc_kill(status_text_helper_proc, SIGTERM);
+        apr_proc_wait(status_text_helper_proc, NULL, NULL, APR_WAIT);
+        status_text_helper_proc = NULL;
     }
+    if (status_text_push == NULL && status_text_agg == NULL && status_text_checkpoint_file == NULL)
+        return;
 
-    fname = ap_server_root_relative(p, filename);
-    if (!fname) {
-        ap_log_error(APLOG_MARK, APLOG_STARTUP|APLOG_CRIT, APR_EBADPATH,
-                     NULL, "Invalid PID file path %s, ignoring.", filename);
+    proc = apr_palloc(p, sizeof(apr_proc_t));
+    rv = apr_proc_fork(proc, p);
+    if (rv == APR_INCHILD) {
+        /* stopped by the parent: last checkpoint */
+        apr_signal(SIGTERM, status_text_helper_term);
+        apr_signal(SIGHUP, SIG_IGN);
+        apr_signal(SIGUSR1, SIG_IGN);
+        if (ap_unixd_setup_child() == 0)
+            status_text_helper_loop(p, parent);
+        /* without the cleanups of the parent pools */
+        _exit(0);
+    }
+    if (rv != APR_INPARENT) {
+        ap_log_error(APLOG_MARK, APLOG_ERR, rv, NULL, "mod_status_text: can't fork the helper process");
         return;
     }
+    apr_pool_note_subprocess(p, proc, APR_KILL_AFTER_TIMEOUT);
+    status_text_helper_proc = proc;
+}
 
-    core_server_config *conf;
-    conf = (core_server_config *)ap_get_module_config(s->module_config,
-							  &core_module);
+/* get the key suffix of a response time range upper bound (in
+ * microseconds): "500us", "50ms", "1s", "1_5s"... */
+static const char *status_text_latency_name(apr_pool_t *p, apr_time_t bound)
+{
+    if (bound%APR_USEC_PER_SEC==0)
+        return apr_psprintf(p, "%" APR_TIME_T_FMT "s", bound/APR_USEC_PER_SEC);
+    if (bound>APR_USEC_PER_SEC && bound%100000==0)
+        return apr_psprintf(p, "%" APR_TIME_T_FMT "_%" APR_TIME_T_FMT "s",
+                            bound/APR_USEC_PER_SEC, (bound%APR_USEC_PER_SEC)/100000);
+    if (bound%1000==0)
+        return apr_psprintf(p, "%" APR_TIME_T_FMT "ms", bound/1000);
+    return apr_psprintf(p, "%" APR_TIME_T_FMT "us", bound);
+}
 
-    if ((rv = apr_file_open(&listen_file, fname,
-                            APR_WRITE | APR_CREATE | APR_TRUNCATE,
-                            APR_UREAD | APR_UWRITE | APR_GREAD | APR_WREAD, p))
-        != APR_SUCCESS) {
-        ap_log_error(APLOG_MARK, APLOG_ERR, rv, NULL,
-                     "could not create %s", fname);
-        ap_log_error(APLOG_MARK, APLOG_ERR, 0, NULL,
-                     "%s: could not log listen information to file %s",
-                     ap_server_argv0, fname);
-        exit(1);
-    }
-    apr_file_printf(listen_file, "ApacheServerRoot: %s\n",ap_server_root);
-    apr_file_printf(listen_file, "ApacheServerDocumentRoot: %s\n",conf->ap_document_root);
+/* ThreadsPerChild of the configuration: the workers of the children of
+ * this generation */
+static int status_text_threads_used(void)
+{
+    int threads_used = 1;
 
-    lr_count=0;
-    for (lr = ap_listeners; lr != NULL; lr = lr->next) 
-    {
-       lr_count++;
-       if (lr->active) 
-       {
-         if (lr->bind_addr->hostname)
-	 apr_file_printf(listen_file, "ApacheListen[%d]: %s://%s:%d\n",
-	      lr_count,
-	      lr->protocol,
-	      lr->bind_addr->hostname,
-	      lr->bind_addr->port);
-         else
-	 apr_file_printf(listen_file, "ApacheListen[%d]: %s://%s:%d\n",
-	      lr_count,
-	      lr->protocol,
-	      "0.0.0.0",
-	      lr->bind_addr->port);
-       }
+    if (threaded) ap_mpm_query(AP_MPMQ_MAX_THREADS, &threads_used);
+    if (threads_used < 1 || threads_used > thread_limit) threads_used = thread_limit;
+    return threads_used;
+}
+
+/* set the response time ranges counted and their key names */
+static void status_text_set_latency_bounds(apr_pool_t *p, const apr_time_t *bounds, int nb_bounds)
+{
+    int i;
+
+    for (i = 0; i < STATUS_TEXT_MAX_LATENCY_BUCKETS; ++i) {
+        if (i < nb_bounds) {
+            status_text_latency_bounds[i] = bounds[i];
+            status_text_latency_keys[i] = status_text_latency_name(p, bounds[i]);
+        }
+        else
+            status_text_latency_bounds[i] = APR_INT64_MAX;
     }
-    apr_file_close(listen_file);
+    status_text_latency_keys[nb_bounds] = "xs";
+    status_text_nb_latency_buckets = nb_bounds + 1;
 }
 
 static int status_text_init(apr_pool_t *p, apr_pool_t *plog, apr_pool_t *ptemp,
                        server_rec *s)
 {
-    status_text_flags[SERVER_DEAD] = '.';  /* We don't want to assume these are in */
-    status_text_flags[SERVER_READY] = '_'; /* any particular order in scoreboard.h */
-    status_text_flags[SERVER_STARTING] = 'S';
-    status_text_flags[SERVER_BUSY_READ] = 'R';
-    status_text_flags[SERVER_BUSY_WRITE] = 'W';
-    status_text_flags[SERVER_BUSY_KEEPALIVE] = 'K';
-    status_text_flags[SERVER_BUSY_LOG] = 'L';
-    status_text_flags[SERVER_BUSY_DNS] = 'D';
-    status_text_flags[SERVER_CLOSING] = 'C';
-    status_text_flags[SERVER_GRACEFUL] = 'G';
-    status_text_flags[SERVER_IDLE_KILL] = 'I';
+    status_text_server_conf *conf;
+    apr_time_t bounds[STATUS_TEXT_MAX_LATENCY_BUCKETS - 1];
+    int nb_bounds, threads_used;
+    int i;
+
+    /* response time ranges of the main server, used when creating the
+     * scoreboard: until then, a restart keeps the ranges of the segment */
+    conf = ap_get_module_config(s->module_config, &status_text_module);
+    if (conf->nb_latency_bounds>0) {
+        status_text_settings.nb_latency_bounds = conf->nb_latency_bounds;
+        memcpy(status_text_settings.latency_bounds, conf->latency_bounds,
+               sizeof(apr_time_t) * conf->nb_latency_bounds);
+    }
+    else {
+        status_text_settings.nb_latency_bounds = sizeof(status_text_default_latency_bounds) / sizeof(apr_time_t);
+        memcpy(status_text_settings.latency_bounds, status_text_default_latency_bounds,
+               sizeof(status_text_default_latency_bounds));
+    }
+    status_text_settings.pool = p;
+    if (status_text_shm_header) {
+        nb_bounds = (int)status_text_shm_header->nb_latency - 1;
+        for (i = 0; i < nb_bounds; ++i)
+            bounds[i] = status_text_shm_header->latency_bounds[i];
+        status_text_set_latency_bounds(p, bounds, nb_bounds);
+    }
+    else
+        status_text_set_latency_bounds(p, status_text_settings.latency_bounds,
+                                       status_text_settings.nb_latency_bounds);
+
+    /* aggregated statistics cache, 0 disables it */
+    status_text_cache_ttl = (conf->cache_ttl>=0) ? conf->cache_ttl : 0;
+
+    /* per second time series ring size, segment export file and helper,
+     * used when creating the scoreboard (not at a graceful restart) */
+    if (conf->series_seconds>=0) status_text_settings.series_seconds = conf->series_seconds;
+    else status_text_settings.series_seconds = STATUS_TEXT_SERIES_DEFAULT_SECONDS;
+    status_text_settings.export_file = conf->export_file ? ap_server_root_relative(p, conf->export_file) : NULL;
+    status_text_settings.push = conf->push;
+    status_text_settings.push_interval = (conf->push_interval>0) ? conf->push_interval
+                                         : STATUS_TEXT_PUSH_DEFAULT_INTERVAL;
+    status_text_settings.push_packet = (conf->push_packet>0) ? conf->push_packet : STATUS_TEXT_PUSH_DEFAULT_PACKET;
+    status_text_settings.agg_interval = (conf->agg_interval>0) ? conf->agg_interval : 0;
+    status_text_settings.checkpoint_file = conf->checkpoint_file ? ap_server_root_relative(p, conf->checkpoint_file)
+                                           : NULL;
+    status_text_settings.checkpoint_interval = (conf->checkpoint_interval>0) ? conf->checkpoint_interval
+                                               : STATUS_TEXT_CHECKPOINT_DEFAULT_INTERVAL;
+    status_text_settings.process_slots = conf->process_slots;
+    status_text_settings.granularity = conf->granularity ? conf->granularity : STATUS_TEXT_GRANULARITY_THREAD;
+
+    /* restart */
+    if (status_text_shm_header) {
+        status_text_shm_header->generation++;
+        /* the walks read the workers of a graceful restart raising
+         * ThreadsPerChild */
+        threads_used = status_text_threads_used();
+        if ((apr_uint32_t)threads_used > status_text_occupancy[0])
+            status_text_occupancy[0] = threads_used;
+    }
+
+    /* status code to counter index table */
+    memset(status_text_code_index, 0, sizeof(status_text_code_index));
+    for (i = 100; i < 600; ++i)
+        status_text_code_index[i] = i / 100;
+    for (i = 0; i < STATUS_TEXT_NB_CODES - STATUS_TEXT_FIRST_CODE; ++i)
+        status_text_code_index[status_text_codes[i]] = STATUS_TEXT_FIRST_CODE + i;
+
+    /* static values and keys of the handler */
+    status_text_init_static(p);
+    status_text_init_keys(p);
+
     /* TODO: must be configurable */
     status_text_log_listen(p,s,"var/listen.txt");
     /* force extended status activation */
@@ -1332,20 +4244,218 @@ static void status_text_child_init(apr_pool_t *p, server_rec *s)
 #ifdef HAVE_TIMES
     child_pid = getpid();
 #endif
+
+    /* block of slots of the child */
+    status_text_my_block = status_text_claim_block();
+    if (status_text_my_block < 0 && status_text_blocks)
+        ap_log_error(APLOG_MARK, APLOG_WARNING, 0, s,
+                     "mod_status_text: no free block of slots (%d blocks, see StatusTextProcessSlots), "
+                     "the requests of this child are only counted in the totals", status_text_nb_blocks);
+
+    /* aggregated statistics cache of the child */
+    status_text_cache = NULL;
+    status_text_cache_valid = 0;
+    if (status_text_cache_ttl > 0) {
+#if APR_HAS_THREADS
+        if (apr_thread_mutex_create(&status_text_cache_mutex, APR_THREAD_MUTEX_DEFAULT, p) != APR_SUCCESS) {
+            ap_log_error(APLOG_MARK, APLOG_ERR, 0, s,
+                         "StatusTextCacheTTL: can't create the cache mutex, cache disabled");
+            return;
+        }
+#endif
+        status_text_cache = apr_palloc(p, STATUS_TEXT_SNAPSHOT_SIZE);
+    }
 }
 
 static apr_status_t status_text_cleanup_scoreboard(void *d)
 {
      if (status_text_scoreboard_shm!=NULL) apr_shm_destroy(status_text_scoreboard_shm);
+     /* the children run the cleanups too, only the parent removes the file */
+     if (status_text_export_mmap!=NULL && getpid()==status_text_export_pid) {
+         status_text_shm_header->superseded = 1;
+         apr_mmap_delete(status_text_export_mmap);
+         apr_file_remove(status_text_export_file, NULL);
+     }
      return APR_SUCCESS;
 }
 
+/* create the segment as a shared mapping of the StatusTextExportFile,
+ * world readable, created under a temporary name */
+static apr_status_t status_text_create_export(apr_pool_t *pool, void **base)
+{
+    const char *tmp = apr_pstrcat(pool, status_text_export_file, ".tmp", NULL);
+    apr_file_t *file;
+    apr_status_t rv;
+
+    apr_file_remove(tmp, pool); /* ignore errors */
+    rv = apr_file_open(&file, tmp, APR_READ | APR_WRITE | APR_CREATE | APR_TRUNCATE | APR_BINARY,
+                       APR_UREAD | APR_UWRITE | APR_GREAD | APR_WREAD, pool);
+    if (rv != APR_SUCCESS) return rv;
+    rv = apr_file_trunc(file, status_text_scoreboard_size);
+    if (rv == APR_SUCCESS)
+        rv = apr_mmap_create(&status_text_export_mmap, file, 0, status_text_scoreboard_size,
+                             APR_MMAP_READ | APR_MMAP_WRITE, pool);
+    apr_file_close(file); /* the mapping stays */
+    if (rv != APR_SUCCESS) {
+        apr_file_remove(tmp, pool);
+        return rv;
+    }
+    status_text_export_pid = getpid();
+    *base = status_text_export_mmap->mm;
+    return APR_SUCCESS;
+}
+
+/* describe the layout of the segment in its header */
+static void status_text_init_shm_header(int nb_slots)
+{
+    status_text_shm_header_t *h = status_text_shm_header;
+    int i;
+
+    memcpy(h->magic, STATUS_TEXT_SHM_MAGIC, 4);
+    h->version = STATUS_TEXT_SHM_VERSION;
+    h->header_size = sizeof(status_text_shm_header_t);
+    h->byte_order = STATUS_TEXT_SHM_BYTE_ORDER;
+    h->cache_line = STATUS_TEXT_CACHE_LINE;
+    h->size = status_text_scoreboard_size;
+    h->create_time = apr_time_now();
+    h->pid = getpid();
+    h->generation = 0;
+    h->superseded = 0;
+
+    h->slots_offset = (char *)status_text_scoreboard - (char *)h;
+    h->nb_slots = nb_slots;
+    h->slot_size = status_text_slot_size;
+    h->blocks_offset = (char *)status_text_blocks - (char *)h;
+    h->nb_blocks = status_text_nb_blocks;
+    h->block_size = status_text_block_size;
+    h->threads = status_text_threads;
+    h->cold_offset = (char *)status_text_scoreboard_cold - (char *)h;
+    h->cold_size = sizeof(status_text_scoreboard_cold_t);
+    h->series_offset = (char *)status_text_series - (char *)h;
+    h->series_seconds = status_text_series_seconds;
+    h->series_size = sizeof(status_text_series_t);
+
+    h->seq_offset = APR_OFFSETOF(status_text_scoreboard_t, seq);
+    h->codes_offset = APR_OFFSETOF(status_text_scoreboard_t, codes);
+    h->nb_codes = STATUS_TEXT_NB_CODES;
+    h->latency_offset = APR_OFFSETOF(status_text_scoreboard_t, nb_reqs_latency);
+    h->nb_latency = status_text_nb_latency_buckets;
+    h->hist_offset = APR_OFFSETOF(status_text_scoreboard_t, hist);
+    h->nb_hist = STATUS_TEXT_HIST_BUCKETS;
+    h->hist_sub_bits = STATUS_TEXT_HIST_SUB_BITS;
+    h->time_sum_offset = APR_OFFSETOF(status_text_scoreboard_t, time_sum);
+    h->max_offset = APR_OFFSETOF(status_text_scoreboard_cold_t, max);
+
+    h->block_used_offset = APR_OFFSETOF(status_text_block_t, used);
+    h->block_fold_start_offset = APR_OFFSETOF(status_text_block_t, fold_start);
+    h->block_fold_end_offset = APR_OFFSETOF(status_text_block_t, fold_end);
+    h->block_codes_offset = APR_OFFSETOF(status_text_block_t, codes);
+    h->block_latency_offset = APR_OFFSETOF(status_text_block_t, nb_reqs_latency);
+    h->block_hist_offset = APR_OFFSETOF(status_text_block_t, hist);
+    h->block_time_sum_offset = APR_OFFSETOF(status_text_block_t, time_sum);
+    h->block_max_offset = APR_OFFSETOF(status_text_block_t, max);
+
+    for (i = 0; i < STATUS_TEXT_MAX_LATENCY_BUCKETS - 1; ++i)
+        h->latency_bounds[i] = status_text_latency_bounds[i];
+    for (i = 1; i < STATUS_TEXT_FIRST_CODE; ++i)
+        h->codes[i] = i;
+    for (i = STATUS_TEXT_FIRST_CODE; i < STATUS_TEXT_NB_CODES; ++i)
+        h->codes[i] = status_text_codes[i - STATUS_TEXT_FIRST_CODE];
+}
+
+/* new response time ranges: drop the counters of the previous ranges,
+ * kept or carried over with the segment, and describe the new ones in its
+ * header */
+static void status_text_reset_latency(void)
+{
+    status_text_shm_header_t *h = status_text_shm_header;
+    int i;
+
+    for (i = 0; i < status_text_nb_blocks * status_text_threads; ++i)
+        memset(STATUS_TEXT_SLOT(i)->nb_reqs_latency, 0, sizeof(STATUS_TEXT_SLOT(i)->nb_reqs_latency));
+    for (i = 0; i <= status_text_nb_blocks; ++i)
+        memset(STATUS_TEXT_BLOCK(i)->nb_reqs_latency, 0, sizeof(STATUS_TEXT_BLOCK(i)->nb_reqs_latency));
+    for (i = 0; i < STATUS_TEXT_MAX_LATENCY_BUCKETS - 1; ++i)
+        h->latency_bounds[i] = status_text_latency_bounds[i];
+    h->nb_latency = status_text_nb_latency_buckets;
+}
+
+/* carry the statistics of the current segment over to a new one (sb,
+ * cold, blocks and series, not yet in use): the totals of each block, with
+ * the counters of its slots, are added to the same block (modulo the new
+ * number of blocks), the moving averages and windows are kept for the
+ * slots that still fit, the per second buckets when there is room in the
+ * new ring. the workers of the previous generation may still update the
+ * current segment during a graceful restart, the copies are done under the
+ * seqlock and the fold counters. */
+static void status_text_migrate(apr_pool_t *p, status_text_scoreboard_t *sb,
+                                status_text_scoreboard_cold_t *cold, status_text_block_t *blocks,
+                                status_text_series_t *series, int nb_blocks, int threads)
+{
+    const status_text_shm_header_t *h = status_text_shm_header;
+    int old_nb = h->nb_blocks, old_threads = h->threads;
+    status_text_scoreboard_t *cur = apr_palloc(p, sizeof(status_text_scoreboard_t) * old_threads);
+    status_text_scoreboard_cold_t *cur_cold = apr_palloc(p, sizeof(status_text_scoreboard_cold_t) * old_threads);
+    status_text_block_t acc, *dst;
+    status_text_scoreboard_t *slot;
+    const status_text_series_t *e;
+    status_text_series_t *d;
+    apr_uint32_t i;
+    int b, t, nb;
+
+    /* the used blocks, then the overflow one */
+    for (b = 0; b <= old_nb; ++b) {
+        if (b < old_nb && !STATUS_TEXT_BLOCK(b)->used)
+            continue;
+        nb = (b < old_nb) ? old_threads : 0;
+        status_text_read_block(&acc, b, nb, cur, cur_cold, sizeof(status_text_scoreboard_t));
+        dst = (status_text_block_t *)((char *)blocks
+              + (apr_size_t)(b < old_nb ? b % nb_blocks : nb_blocks) * status_text_block_size);
+        status_text_add_block_counters(dst, &acc);
+        dst->used = 1;
+        for (t = 0; t < nb; ++t) {
+            /* only the maximum, the windows of another slot would not fit */
+            if (b >= nb_blocks || t >= threads) {
+                if (cur_cold[t].max > dst->max)
+                    dst->max = cur_cold[t].max;
+                continue;
+            }
+            /* the counters are in the block totals */
+            slot = (status_text_scoreboard_t *)((char *)sb + (apr_size_t)(b * threads + t) * status_text_slot_size);
+            memcpy(slot, &cur[t], sizeof(status_text_scoreboard_t));
+            slot->seq = 0;
+            memset(slot->counters, 0, sizeof(slot->counters));
+            slot->time_sum = 0;
+            cold[b * threads + t] = cur_cold[t];
+        }
+    }
+
+    if (status_text_series_seconds == 0)
+        return;
+    for (i = 0; i < h->series_seconds; ++i) {
+        e = &status_text_series[i];
+        if (e->second == 0 || e->second == STATUS_TEXT_SERIES_RESET)
+            continue;
+        d = &series[e->second % status_text_series_seconds];
+        if (d->second < e->second)
+            *d = *e;
+    }
+}
+
 int status_text_create_scoreboard(apr_pool_t *p, ap_scoreboard_e sb_type)
 {
     apr_status_t rv;
     apr_pool_t *global_pool;
-    //void *sb_shared;
     char *fname = NULL;
+    void *base;
+    int nb_slots, nb_blocks, threads, threads_used, delta_keys, latency_changed;
+    apr_size_t size;
+    status_text_scoreboard_t *sb;
+    status_text_scoreboard_cold_t *cold;
+    status_text_block_t *blocks;
+    volatile apr_uint32_t *occupancy;
+    status_text_series_t *series;
+    apr_uint32_t generation;
 
     if (sb_type != SB_SHARED) {
 	ap_log_error(APLOG_MARK, APLOG_CRIT, 0, NULL,
@@ -1353,18 +4463,107 @@ int status_text_create_scoreboard(apr_pool_t *p, ap_scoreboard_e sb_type)
 	return HTTP_INTERNAL_SERVER_ERROR;
     }
 
+    /* the settings of the configuration */
+    status_text_series_seconds = status_text_settings.series_seconds;
+    status_text_export_file = status_text_settings.export_file;
+    status_text_push = status_text_settings.push;
+    status_text_push_interval = status_text_settings.push_interval;
+    status_text_push_packet = status_text_settings.push_packet;
+    status_text_agg_interval = status_text_settings.agg_interval;
+    status_text_checkpoint_file = status_text_settings.checkpoint_file;
+    status_text_checkpoint_interval = status_text_settings.checkpoint_interval;
+    status_text_process_slots = status_text_settings.process_slots;
+    status_text_granularity = status_text_settings.granularity;
+
+    /* new response time ranges, and their keys (the children of the
+     * previous segment were stopped) */
+    latency_changed = status_text_nb_latency_buckets != status_text_settings.nb_latency_bounds + 1 ||
+        memcmp(status_text_latency_bounds, status_text_settings.latency_bounds,
+               sizeof(apr_time_t) * status_text_settings.nb_latency_bounds) != 0;
+    if (latency_changed) {
+        status_text_set_latency_bounds(status_text_settings.pool, status_text_settings.latency_bounds,
+                                       status_text_settings.nb_latency_bounds);
+        status_text_init_keys(status_text_settings.pool);
+    }
+
     /* initialisze globale vars */
     ap_mpm_query(AP_MPMQ_HARD_LIMIT_THREADS, &thread_limit);
     ap_mpm_query(AP_MPMQ_HARD_LIMIT_DAEMONS, &server_limit);
     ap_mpm_query(AP_MPMQ_IS_THREADED, &threaded);
     ap_mpm_query(AP_MPMQ_IS_FORKED, &forked);
 
-    /* calculate the status text scoreboard size */
-    if (threaded) status_text_scoreboard_size = sizeof(status_text_scoreboard_t) * server_limit * thread_limit;
-    else status_text_scoreboard_size = sizeof(status_text_scoreboard_t) * server_limit;
+    /* a block of slots per child: ThreadsPerChild slots (one without
+     * threads or with StatusTextGranularity process), as many blocks as MaxRequestWorkers needs processes (twice
+     * with threads, the children of the previous generation finish their
+     * requests during a graceful restart), at most ServerLimit, or
+     * StatusTextProcessSlots */
+    threads = 1;
+    if (threaded && status_text_granularity == STATUS_TEXT_GRANULARITY_THREAD)
+        ap_mpm_query(AP_MPMQ_MAX_THREADS, &threads);
+    if (threads < 1) threads = 1;
+    if (threads > thread_limit) threads = thread_limit;
+    if (status_text_process_slots > 0) nb_blocks = status_text_process_slots;
+    else {
+        ap_mpm_query(AP_MPMQ_MAX_DAEMONS, &nb_blocks);
+        if (threaded) nb_blocks *= 2;
+    }
+    if (nb_blocks > server_limit) nb_blocks = server_limit;
+    if (nb_blocks < 1) nb_blocks = 1;
+    nb_slots = nb_blocks * threads;
+
+    /* the workers of the children of this generation */
+    threads_used = status_text_threads_used();
+
+    /* calculate the status text scoreboard size: the header, cache line
+     * aligned slots followed by the cache line aligned blocks (and the
+     * overflow one) and the cold fields, plus one cache line to align the
+     * slots (the shm base address is not cache line aligned).
+     * a restart keeps the room of the delta keys while the keys fit, the
+     * delta entries have room for the worker lines of nb_blocks children */
+    status_text_slot_size = APR_ALIGN(sizeof(status_text_scoreboard_t), STATUS_TEXT_CACHE_LINE);
+    status_text_block_size = APR_ALIGN(sizeof(status_text_block_t), STATUS_TEXT_CACHE_LINE);
+    delta_keys = status_text_keys->nelts + STATUS_TEXT_DELTA_EXTRA_KEYS;
+    if (status_text_shm_header && status_text_keys->nelts <= status_text_delta_keys)
+        delta_keys = status_text_delta_keys;
+    status_text_delta_keys = delta_keys;
+    status_text_delta_lines = (apr_uint32_t)(nb_blocks * threads_used);
+    status_text_delta_size = APR_ALIGN_DEFAULT(APR_ALIGN_DEFAULT(sizeof(status_text_delta_t))
+                             + sizeof(apr_uint64_t) * (status_text_delta_keys + 2 * (apr_size_t)status_text_delta_lines));
+    size = STATUS_TEXT_SHM_HEADER_SIZE
+         + STATUS_TEXT_CACHE_LINE
+         + status_text_slot_size * nb_slots
+         + status_text_block_size * (nb_blocks + 1)
+         + sizeof(status_text_scoreboard_cold_t) * nb_slots
+         + STATUS_TEXT_OCC_SIZE
+         + sizeof(status_text_series_t) * status_text_series_seconds
+         + STATUS_TEXT_CACHE_LINE
+         + status_text_delta_size * STATUS_TEXT_DELTA_TOKENS;
+    /* the aggregator buffers, cache line aligned */
+    status_text_agg_size = APR_ALIGN(STATUS_TEXT_SNAPSHOT_SIZE, STATUS_TEXT_CACHE_LINE);
+    if (status_text_agg_interval > 0)
+        size += 2 * STATUS_TEXT_CACHE_LINE + 2 * status_text_agg_size;
+
+    /* restart with the same layout: keep the segment and its statistics */
+    if (status_text_shm_header && status_text_layout.size == size &&
+        status_text_layout.server_limit == server_limit && status_text_layout.thread_limit == thread_limit &&
+        status_text_layout.nb_blocks == nb_blocks && status_text_layout.threads == threads &&
+        status_text_layout.series_seconds == status_text_series_seconds &&
+        (status_text_export_file ? status_text_layout.export_file &&
+                                   strcmp(status_text_layout.export_file, status_text_export_file) == 0
+                                 : status_text_layout.export_file == NULL)) {
+        status_text_export_file = status_text_layout.export_file;
+        if ((apr_uint32_t)threads_used > status_text_occupancy[0])
+            status_text_occupancy[0] = threads_used;
+        if (latency_changed)
+            status_text_reset_latency();
+        status_text_start_helper(p);
+        return APR_SUCCESS;
+    }
+    status_text_scoreboard_size = size;
 
     /* We don't want to have to recreate the scoreboard after
-     * restarts, so we'll create a global pool and never clean it.
+     * restarts, so we'll create a global pool and never clean it
+     * (unless the layout changes).
      */
     rv = apr_pool_create(&global_pool, NULL);
     if (rv != APR_SUCCESS) {
@@ -1374,14 +4573,29 @@ int status_text_create_scoreboard(apr_pool_t *p, ap_scoreboard_e sb_type)
         return rv;
     }
 
-    /* generate the shm file name */
-    status_text_scorebored_name = "logs/scoreboard_runtime";
+    /* generate the shm file name, a new one while the previous segment is
+     * still there */
+    status_text_scorebored_name = status_text_shm_header ?
+        apr_psprintf(global_pool, "logs/scoreboard_runtime.%lu", (unsigned long)status_text_shm_header->generation)
+        : "logs/scoreboard_runtime";
     fname = ap_server_root_relative(p, status_text_scorebored_name);
 
+    /* a mapping of the StatusTextExportFile for the local agents */
+    status_text_scoreboard_shm = NULL;
+    status_text_export_mmap = NULL;
+    if (status_text_export_file) {
+	status_text_export_file = apr_pstrdup(global_pool, status_text_export_file);
+	rv = status_text_create_export(global_pool, &base);
+	if (rv != APR_SUCCESS) {
+	    ap_log_error(APLOG_MARK, APLOG_CRIT, rv, NULL,
+			 "unable to create the status_text export file \"%s\"",
+			 status_text_export_file);
+	    return HTTP_INTERNAL_SERVER_ERROR;
+	}
+    }
     /* try anonymous shared memory before */
-    rv = apr_shm_create(&status_text_scoreboard_shm, status_text_scoreboard_size, NULL,
-			global_pool); /* anonymous shared memory */
-    if ((rv != APR_SUCCESS) && (rv != APR_ENOTIMPL)) {
+    else if ((rv = apr_shm_create(&status_text_scoreboard_shm, status_text_scoreboard_size, NULL,
+				  global_pool)) != APR_SUCCESS && rv != APR_ENOTIMPL) { /* anonymous shared memory */
 	ap_log_error(APLOG_MARK, APLOG_CRIT, rv, NULL,
 		     "Unable to create or access status_text scoreboard "
 		     "(anonymous shared memory failure)");
@@ -1400,29 +4614,430 @@ int status_text_create_scoreboard(apr_pool_t *p, ap_scoreboard_e sb_type)
 			 "(name-based shared memory failure)", fname);
 	}
     }
-    if (rv || !(status_text_scoreboard = apr_shm_baseaddr_get(status_text_scoreboard_shm))) {
+    if (rv) {
 	return HTTP_INTERNAL_SERVER_ERROR;
     }
+    if (status_text_scoreboard_shm) {
+	if (!(base = apr_shm_baseaddr_get(status_text_scoreboard_shm)))
+	    return HTTP_INTERNAL_SERVER_ERROR;
+	status_text_scoreboard_size = apr_shm_size_get(status_text_scoreboard_shm);
+    }
 
     /* initialize the scoreboard */
-    status_text_scoreboard_size = apr_shm_size_get(status_text_scoreboard_shm);
-    memset(status_text_scoreboard,0,status_text_scoreboard_size);
+    memset(base,0,status_text_scoreboard_size);
+
+    /* lay out the slots from the first cache line boundary after the header */
+    sb = (status_text_scoreboard_t *)
+        APR_ALIGN((apr_uintptr_t)base + STATUS_TEXT_SHM_HEADER_SIZE, STATUS_TEXT_CACHE_LINE);
+    blocks = (status_text_block_t *)((char *)sb + status_text_slot_size * nb_slots);
+    cold = (status_text_scoreboard_cold_t *)((char *)blocks + status_text_block_size * (nb_blocks + 1));
+    occupancy = (volatile apr_uint32_t *)(cold + nb_slots);
+    series = (status_text_series_t *)((char *)occupancy + STATUS_TEXT_OCC_SIZE);
+
+    /* the occupancy of the previous segment with the same limits, else
+     * every worker may have counters */
+    occupancy[0] = threads_used;
+    if (status_text_occupancy && status_text_layout.server_limit == server_limit &&
+        status_text_layout.thread_limit == thread_limit) {
+        memcpy((void *)occupancy, (const void *)status_text_occupancy, STATUS_TEXT_OCC_SIZE);
+        if ((apr_uint32_t)threads_used > occupancy[0])
+            occupancy[0] = threads_used;
+    }
+    else if (status_text_occupancy) {
+        occupancy[0] = thread_limit;
+        memset((char *)occupancy + sizeof(apr_uint32_t), 0xff, STATUS_TEXT_OCC_SIZE - sizeof(apr_uint32_t));
+    }
+
+    /* the limits changed: carry the statistics over, then drop the
+     * previous segment (the children of the previous generation keep their
+     * mapping) */
+    generation = 0;
+    if (status_text_shm_header) {
+        status_text_migrate(p, sb, cold, blocks, series, nb_blocks, threads);
+        generation = status_text_shm_header->generation;
+        /* the agents mapping the export file map the new one */
+        STATUS_TEXT_WRITE_BARRIER();
+        status_text_shm_header->superseded = 1;
+        if (status_text_layout.export_file &&
+            (!status_text_export_file || strcmp(status_text_layout.export_file, status_text_export_file) != 0))
+            apr_file_remove(status_text_layout.export_file, p);
+        apr_pool_destroy(status_text_segment_pool);
+        ap_log_error(APLOG_MARK, APLOG_INFO, 0, NULL,
+                     "mod_status_text: statistics carried over to a new segment of %d blocks of %d slots",
+                     nb_blocks, threads);
+    }
+
+    status_text_shm_header = base;
+    status_text_scoreboard = sb;
+    status_text_scoreboard_cold = cold;
+    status_text_occupancy = occupancy;
+    status_text_blocks = blocks;
+    status_text_nb_blocks = nb_blocks;
+    status_text_threads = threads;
+    status_text_series = series;
+    status_text_delta_seq = (volatile apr_uint32_t *)(status_text_series + status_text_series_seconds);
+    status_text_delta = (status_text_delta_t *)((char *)status_text_delta_seq + STATUS_TEXT_CACHE_LINE);
+    status_text_agg = NULL;
+    if (status_text_agg_interval > 0)
+        status_text_agg = (status_text_agg_t *)APR_ALIGN((apr_uintptr_t)STATUS_TEXT_DELTA(STATUS_TEXT_DELTA_TOKENS),
+                                                         STATUS_TEXT_CACHE_LINE);
+    status_text_init_shm_header(nb_slots);
+    status_text_shm_header->generation = generation;
+    if (latency_changed)
+        status_text_reset_latency();
+
+    /* first segment: the counters of the last checkpoint */
+    if (status_text_segment_pool == NULL && status_text_checkpoint_file)
+        status_text_checkpoint_load(p);
+
+    /* publish the export file, initialized */
+    if (status_text_export_mmap) {
+	rv = apr_file_rename(apr_pstrcat(p, status_text_export_file, ".tmp", NULL),
+			     status_text_export_file, p);
+	if (rv != APR_SUCCESS) {
+	    ap_log_error(APLOG_MARK, APLOG_CRIT, rv, NULL,
+			 "unable to rename the status_text export file to \"%s\"",
+			 status_text_export_file);
+	    return HTTP_INTERNAL_SERVER_ERROR;
+	}
+    }
+
+    /* register auto cleanup of the shm, once */
+    if (status_text_segment_pool == NULL)
+        apr_pool_cleanup_register(p, NULL, status_text_cleanup_scoreboard, apr_pool_cleanup_null);
+
+    status_text_segment_pool = global_pool;
+    status_text_layout.server_limit = server_limit;
+    status_text_layout.thread_limit = thread_limit;
+    status_text_layout.nb_blocks = nb_blocks;
+    status_text_layout.threads = threads;
+    status_text_layout.series_seconds = status_text_series_seconds;
+    status_text_layout.size = size;
+    status_text_layout.export_file = status_text_export_file;
 
-    /* register auto cleanup of the shm */
-    apr_pool_cleanup_register(p, NULL, status_text_cleanup_scoreboard, apr_pool_cleanup_null);
+    /* aggregator and push helper, reading the new scoreboard */
+    status_text_start_helper(p);
 
     return APR_SUCCESS;
 }
 
+static void *status_text_create_server_config(apr_pool_t *p, server_rec *s)
+{
+    status_text_server_conf *conf = apr_pcalloc(p, sizeof(status_text_server_conf));
+    conf->series_seconds = -1;
+    conf->cache_ttl = -1;
+    conf->push_interval = -1;
+    conf->agg_interval = -1;
+    conf->checkpoint_interval = -1;
+    return conf;
+}
+
+static void *status_text_merge_server_config(apr_pool_t *p, void *basev, void *addv)
+{
+    status_text_server_conf *base = basev;
+    status_text_server_conf *add = addv;
+    status_text_server_conf *conf = apr_pcalloc(p, sizeof(status_text_server_conf));
+
+    /* the response time ranges are counted by the workers for all the
+     * servers, they are only read from the main server */
+    conf->series_seconds = (add->series_seconds >= 0) ? add->series_seconds : base->series_seconds;
+    conf->cache_ttl = (add->cache_ttl >= 0) ? add->cache_ttl : base->cache_ttl;
+    conf->export_file = add->export_file ? add->export_file : base->export_file;
+    conf->push = add->push ? add->push : base->push;
+    conf->push_interval = (add->push_interval >= 0) ? add->push_interval : base->push_interval;
+    conf->push_packet = add->push_packet ? add->push_packet : base->push_packet;
+    conf->agg_interval = (add->agg_interval >= 0) ? add->agg_interval : base->agg_interval;
+    conf->checkpoint_file = add->checkpoint_file ? add->checkpoint_file : base->checkpoint_file;
+    conf->checkpoint_interval = (add->checkpoint_interval >= 0) ? add->checkpoint_interval : base->checkpoint_interval;
+    conf->process_slots = add->process_slots ? add->process_slots : base->process_slots;
+    conf->granularity = add->granularity ? add->granularity : base->granularity;
+    return conf;
+}
+
+/* parse a response time in microseconds, with an optional unit (the
+ * default is ms): "50", "250us", "50ms", "1.5s" */
+static const char *status_text_parse_time(const char *arg, apr_time_t *value)
+{
+    char *end;
+    double v = strtod(arg, &end);
+
+    if (end == arg)
+        return "must be a positive response time";
+    if (*end == '\0' || strcasecmp(end, "ms") == 0)
+        v *= 1000;
+    else if (strcasecmp(end, "s") == 0)
+        v *= APR_USEC_PER_SEC;
+    else if (strcasecmp(end, "us") != 0)
+        return "unknown time unit, use us, ms or s";
+    /* not a number, infinite or out of the apr_time_t range (the query
+     * string comes from the client) */
+    if (!(v >= 0 && v + 0.5 < (double)APR_INT64_MAX))
+        return "must be a positive response time";
+    *value = (apr_time_t)(v + 0.5);
+    return NULL;
+}
+
+static const char *set_latency_buckets(cmd_parms *cmd, void *dummy, const char *arg)
+{
+    status_text_server_conf *conf =
+        ap_get_module_config(cmd->server->module_config, &status_text_module);
+    const char *err = ap_check_cmd_context(cmd, GLOBAL_ONLY);
+    apr_time_t bound;
+
+    if (err != NULL)
+        return err;
+
+    if ((err = status_text_parse_time(arg, &bound)) != NULL)
+        return apr_pstrcat(cmd->pool, "StatusTextLatencyBuckets ", arg, ": ", err, NULL);
+    if (bound == 0)
+        return "StatusTextLatencyBuckets boundaries must be greater than 0";
+    if (conf->nb_latency_bounds > 0 &&
+        bound <= conf->latency_bounds[conf->nb_latency_bounds - 1])
+        return "StatusTextLatencyBuckets boundaries must be sorted in increasing order";
+    if (conf->nb_latency_bounds >= STATUS_TEXT_MAX_LATENCY_BUCKETS - 1)
+        return apr_psprintf(cmd->pool, "StatusTextLatencyBuckets accepts at most %d boundaries",
+                            STATUS_TEXT_MAX_LATENCY_BUCKETS - 1);
+
+    conf->latency_bounds[conf->nb_latency_bounds++] = bound;
+    return NULL;
+}
+
+static const char *set_series_seconds(cmd_parms *cmd, void *dummy, const char *arg)
+{
+    status_text_server_conf *conf =
+        ap_get_module_config(cmd->server->module_config, &status_text_module);
+    const char *err = ap_check_cmd_context(cmd, GLOBAL_ONLY);
+    int seconds;
+
+    if (err != NULL)
+        return err;
+
+    seconds = atoi(arg);
+    if (seconds < 1 || seconds > STATUS_TEXT_SERIES_MAX_SECONDS)
+        return apr_psprintf(cmd->pool, "StatusTextSeriesSeconds must be between 1 and %d",
+                            STATUS_TEXT_SERIES_MAX_SECONDS);
+    conf->series_seconds = seconds;
+    return NULL;
+}
+
+static const char *set_cache_ttl(cmd_parms *cmd, void *dummy, const char *arg)
+{
+    status_text_server_conf *conf =
+        ap_get_module_config(cmd->server->module_config, &status_text_module);
+    const char *err = ap_check_cmd_context(cmd, GLOBAL_ONLY);
+    apr_time_t ttl;
+
+    if (err != NULL)
+        return err;
+
+    if ((err = status_text_parse_time(arg, &ttl)) != NULL)
+        return apr_pstrcat(cmd->pool, "StatusTextCacheTTL ", arg, ": ", err, NULL);
+    conf->cache_ttl = ttl;
+    return NULL;
+}
+
+static const char *set_export_file(cmd_parms *cmd, void *dummy, const char *arg)
+{
+    status_text_server_conf *conf =
+        ap_get_module_config(cmd->server->module_config, &status_text_module);
+    const char *err = ap_check_cmd_context(cmd, GLOBAL_ONLY);
+
+    if (err != NULL)
+        return err;
+
+    conf->export_file = arg;
+    return NULL;
+}
+
+static const char *set_push(cmd_parms *cmd, void *dummy, const char *arg)
+{
+    status_text_server_conf *conf =
+        ap_get_module_config(cmd->server->module_config, &status_text_module);
+    const char *err = ap_check_cmd_context(cmd, GLOBAL_ONLY);
+    char *host, *scope;
+    apr_port_t port;
+
+    if (err != NULL)
+        return err;
+
+#if APR_HAVE_SOCKADDR_UN
+    if (strncmp(arg, "unix:", 5) == 0 && arg[5]) {
+        conf->push = arg;
+        return NULL;
+    }
+#endif
+    if (strncmp(arg, "udp://", 6) != 0 ||
+        apr_parse_addr_port(&host, &scope, &port, arg + 6, cmd->pool) != APR_SUCCESS ||
+        host == NULL || port == 0)
+#if APR_HAVE_SOCKADDR_UN
+        return "StatusTextPush must be udp://host:port or unix:/path";
+#else
+        return "StatusTextPush must be udp://host:port";
+#endif
+    conf->push = arg;
+    return NULL;
+}
+
+static const char *set_push_interval(cmd_parms *cmd, void *dummy, const char *arg)
+{
+    status_text_server_conf *conf =
+        ap_get_module_config(cmd->server->module_config, &status_text_module);
+    const char *err = ap_check_cmd_context(cmd, GLOBAL_ONLY);
+    apr_time_t interval;
+
+    if (err != NULL)
+        return err;
+
+    if ((err = status_text_parse_time(arg, &interval)) != NULL)
+        return apr_pstrcat(cmd->pool, "StatusTextPushInterval ", arg, ": ", err, NULL);
+    if (interval < 1000)
+        return "StatusTextPushInterval must be at least 1ms";
+    conf->push_interval = interval;
+    return NULL;
+}
+
+static const char *set_push_packet_size(cmd_parms *cmd, void *dummy, const char *arg)
+{
+    status_text_server_conf *conf =
+        ap_get_module_config(cmd->server->module_config, &status_text_module);
+    const char *err = ap_check_cmd_context(cmd, GLOBAL_ONLY);
+    int size;
+
+    if (err != NULL)
+        return err;
+
+    size = atoi(arg);
+    if (size < 256 || size > STATUS_TEXT_PUSH_MAX_PACKET)
+        return apr_psprintf(cmd->pool, "StatusTextPushPacketSize must be between 256 and %d",
+                            STATUS_TEXT_PUSH_MAX_PACKET);
+    conf->push_packet = size;
+    return NULL;
+}
+
+static const char *set_agg_interval(cmd_parms *cmd, void *dummy, const char *arg)
+{
+    status_text_server_conf *conf =
+        ap_get_module_config(cmd->server->module_config, &status_text_module);
+    const char *err = ap_check_cmd_context(cmd, GLOBAL_ONLY);
+    apr_time_t interval;
+
+    if (err != NULL)
+        return err;
+
+    if ((err = status_text_parse_time(arg, &interval)) != NULL)
+        return apr_pstrcat(cmd->pool, "StatusTextAggregateInterval ", arg, ": ", err, NULL);
+    if (interval != 0 && interval < 10000)
+        return "StatusTextAggregateInterval must be 0 or at least 10ms";
+    conf->agg_interval = interval;
+    return NULL;
+}
+
+static const char *set_checkpoint_file(cmd_parms *cmd, void *dummy, const char *arg)
+{
+    status_text_server_conf *conf =
+        ap_get_module_config(cmd->server->module_config, &status_text_module);
+    const char *err = ap_check_cmd_context(cmd, GLOBAL_ONLY);
+
+    if (err != NULL)
+        return err;
+
+    conf->checkpoint_file = arg;
+    return NULL;
+}
+
+static const char *set_checkpoint_interval(cmd_parms *cmd, void *dummy, const char *arg)
+{
+    status_text_server_conf *conf =
+        ap_get_module_config(cmd->server->module_config, &status_text_module);
+    const char *err = ap_check_cmd_context(cmd, GLOBAL_ONLY);
+    apr_time_t interval;
+
+    if (err != NULL)
+        return err;
+
+    if ((err = status_text_parse_time(arg, &interval)) != NULL)
+        return apr_pstrcat(cmd->pool, "StatusTextCheckpointInterval ", arg, ": ", err, NULL);
+    if (interval < apr_time_from_sec(1))
+        return "StatusTextCheckpointInterval must be at least 1s";
+    conf->checkpoint_interval = interval;
+    return NULL;
+}
+
+static const char *set_process_slots(cmd_parms *cmd, void *dummy, const char *arg)
+{
+    status_text_server_conf *conf =
+        ap_get_module_config(cmd->server->module_config, &status_text_module);
+    const char *err = ap_check_cmd_context(cmd, GLOBAL_ONLY);
+    int slots;
+
+    if (err != NULL)
+        return err;
+
+    slots = atoi(arg);
+    if (slots < 1)
+        return "StatusTextProcessSlots must be at least 1";
+    conf->process_slots = slots;
+    return NULL;
+}
+
+static const char *set_granularity(cmd_parms *cmd, void *dummy, const char *arg)
+{
+    status_text_server_conf *conf =
+        ap_get_module_config(cmd->server->module_config, &status_text_module);
+    const char *err = ap_check_cmd_context(cmd, GLOBAL_ONLY);
+
+    if (err != NULL)
+        return err;
+
+    if (strcasecmp(arg, "thread") == 0)
+        conf->granularity = STATUS_TEXT_GRANULARITY_THREAD;
+    else if (strcasecmp(arg, "process") == 0)
+        conf->granularity = STATUS_TEXT_GRANULARITY_PROCESS;
+    else
+        return "StatusTextGranularity must be thread or process";
+    return NULL;
+}
+
+static const command_rec status_text_cmds[] =
+{
+    AP_INIT_ITERATE("StatusTextLatencyBuckets", set_latency_buckets, NULL, RSRC_CONF,
+                    "sorted response time ranges upper bounds (ms, or with a us/ms/s unit)"),
+    AP_INIT_TAKE1("StatusTextSeriesSeconds", set_series_seconds, NULL, RSRC_CONF,
+                  "number of seconds kept in the per second time series (default 300)"),
+    AP_INIT_TAKE1("StatusTextCacheTTL", set_cache_ttl, NULL, RSRC_CONF,
+                  "time the aggregated statistics are reused by a child (ms, or with a us/ms/s unit, 0 to disable)"),
+    AP_INIT_TAKE1("StatusTextExportFile", set_export_file, NULL, RSRC_CONF,
+                  "file the statistics segment is mapped from, for the local agents (see status_text_shm.h)"),
+    AP_INIT_TAKE1("StatusTextPush", set_push, NULL, RSRC_CONF,
+                  "StatsD target the statistics are pushed to: udp://host:port or unix:/path"),
+    AP_INIT_TAKE1("StatusTextPushInterval", set_push_interval, NULL, RSRC_CONF,
+                  "time between two pushes (ms, or with a us/ms/s unit, default 10s)"),
+    AP_INIT_TAKE1("StatusTextPushPacketSize", set_push_packet_size, NULL, RSRC_CONF,
+                  "maximum size of a pushed datagram (default 1432)"),
+    AP_INIT_TAKE1("StatusTextAggregateInterval", set_agg_interval, NULL, RSRC_CONF,
+                  "time between two snapshots of the aggregator process (ms, or with a us/ms/s unit, 0 to disable)"),
+    AP_INIT_TAKE1("StatusTextCheckpointFile", set_checkpoint_file, NULL, RSRC_CONF,
+                  "file the counters are saved to, and loaded from at startup"),
+    AP_INIT_TAKE1("StatusTextCheckpointInterval", set_checkpoint_interval, NULL, RSRC_CONF,
+                  "time between two checkpoints (ms, or with a us/ms/s unit, default 60s)"),
+    AP_INIT_TAKE1("StatusTextProcessSlots", set_process_slots, NULL, RSRC_CONF,
+                  "number of child processes with their own statistics slots (default from MaxRequestWorkers, at most ServerLimit)"),
+    AP_INIT_TAKE1("StatusTextGranularity", set_granularity, NULL, RSRC_CONF,
+                  "statistics slot per thread (default) or per process, shared by its threads"),
+    {NULL}
+};
+
 static void register_hooks(apr_pool_t *p)
 {
     //static const char * const aszPre[]={ "mod_status.c",NULL };
+    ap_hook_post_read_request(status_text_request_start,NULL,NULL,APR_HOOK_REALLY_FIRST);
     ap_hook_log_transaction(runtime_statistique,NULL,NULL,APR_HOOK_MIDDLE);
     ap_hook_handler(status_text_handler, NULL, NULL, APR_HOOK_MIDDLE);
     //ap_hook_post_config(status_text_init, aszPre, NULL, APR_HOOK_MIDDLE);
     ap_hook_post_config(status_text_init, NULL, NULL, APR_HOOK_MIDDLE);
     ap_hook_child_init(status_text_child_init, NULL, NULL, APR_HOOK_MIDDLE);
-    ap_hook_pre_mpm(status_text_create_scoreboard, NULL, NULL, APR_HOOK_MIDDLE);
+    /* last, the helper process forked there reads the apache scoreboard */
+    ap_hook_pre_mpm(status_text_create_scoreboard, NULL, NULL, APR_HOOK_LAST);
 }
 
 module AP_MODULE_DECLARE_DATA status_text_module =
@@ -1430,9 +5045,9 @@ module AP_MODULE_DECLARE_DATA status_text_module =
     STANDARD20_MODULE_STUFF,
     NULL,                       /* dir config creater */
     NULL,                       /* dir merger --- default is to override */
-    NULL,                       /* server config */
-    NULL,                       /* merge server config */
-    NULL,         		/* command table */
+    status_text_create_server_config, /* server config */
+    status_text_merge_server_config,  /* merge server config */
+    status_text_cmds,           /* command table */
     register_hooks              /* register_hooks */
 };
 
@@ -0,0 +1,139 @@
+/* Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/* binary format of mod_status_text (?format=binary) and its reference
+ * decoder (status_text_decode.c).
+ *
+ * all the integers are little endian, the floating point values are IEEE
+ * 754 doubles in little endian. a snapshot is:
+ *
+ *   header        STATUS_TEXT_BINARY_HEADER_SIZE bytes
+ *   metric table  nb_metrics entries of STATUS_TEXT_BINARY_ENTRY_SIZE bytes
+ *   names         names_size bytes: the metric names, NUL terminated
+ *   data          data_size bytes: the metric values, 8 bytes aligned
+ *
+ * header:
+ *   0  4 bytes magic "STXB"
+ *   4  u16     version (STATUS_TEXT_BINARY_VERSION)
+ *   6  u16     header size
+ *   8  u32     number of metrics
+ *   12 u32     metric entry size
+ *   16 u32     names size (multiple of 8)
+ *   20 u32     data size
+ *   24 u64     current time (microseconds since the epoch)
+ *   32 u64     restart time (microseconds since the epoch)
+ *   40 u32     server generation
+ *   44 u32     reserved (0)
+ *
+ * metric entry:
+ *   0  u32     id: 32 bits FNV-1a hash of the name
+ *   4  u8      kind of the value (STATUS_TEXT_BINARY_*)
+ *   5  u8      type of the key (STATUS_TEXT_BINARY_TYPE_*)
+ *   6  u16     reserved (0)
+ *   8  u32     offset of the name in the names
+ *   12 u32     number of values (bytes for a string, pairs for an histogram)
+ *   16 u32     offset of the values in the data
+ *   20 u32     reserved (0)
+ *
+ * the response times are in microseconds (the text output has them in
+ * milliseconds). a decoder must skip the metrics of an unknown kind, and
+ * use the header and entry sizes of the snapshot: the next versions only
+ * add fields at their end, and bytes after the data, a decoder reads the
+ * snapshots of any version from 1 and skips what it does not know.
+ */
+
+#ifndef STATUS_TEXT_BINARY_H
+#define STATUS_TEXT_BINARY_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define STATUS_TEXT_BINARY_MAGIC       "STXB"
+#define STATUS_TEXT_BINARY_VERSION     1
+#define STATUS_TEXT_BINARY_HEADER_SIZE 48
+#define STATUS_TEXT_BINARY_ENTRY_SIZE  24
+#define STATUS_TEXT_BINARY_CONTENT_TYPE "application/x-status-text-binary"
+
+/* kinds of values */
+#define STATUS_TEXT_BINARY_F64       1 /* a double */
+#define STATUS_TEXT_BINARY_STRING    2 /* bytes, without NUL */
+#define STATUS_TEXT_BINARY_U64_ARRAY 3 /* u64 values (per second series) */
+#define STATUS_TEXT_BINARY_HISTOGRAM 4 /* u64 pairs: upper bound, count */
+
+/* types of the keys */
+#define STATUS_TEXT_BINARY_TYPE_STRING    0
+#define STATUS_TEXT_BINARY_TYPE_GAUGE     1
+#define STATUS_TEXT_BINARY_TYPE_COUNTER   2
+#define STATUS_TEXT_BINARY_TYPE_SERIES    3
+#define STATUS_TEXT_BINARY_TYPE_HISTOGRAM 4
+
+/* decoder errors */
+#define STATUS_TEXT_BINARY_OK         0
+#define STATUS_TEXT_BINARY_ETRUNCATED 1 /* the snapshot is truncated */
+#define STATUS_TEXT_BINARY_EMAGIC     2 /* not a snapshot */
+#define STATUS_TEXT_BINARY_EVERSION   3 /* unsupported version */
+#define STATUS_TEXT_BINARY_ECORRUPT   4 /* invalid offset or size */
+
+/* a decoded snapshot, pointing in the buffer given to status_text_binary_open */
+typedef struct {
+    unsigned version;
+    uint32_t nb_metrics;
+    uint64_t current_time;
+    uint64_t restart_time;
+    uint32_t generation;
+    const unsigned char *table;
+    uint32_t entry_size;
+    const char *names;
+    uint32_t names_size;
+    const unsigned char *data;
+    uint32_t data_size;
+} status_text_binary_t;
+
+/* a metric of a snapshot */
+typedef struct {
+    uint32_t id;
+    unsigned kind;   /* STATUS_TEXT_BINARY_* */
+    unsigned type;   /* STATUS_TEXT_BINARY_TYPE_* */
+    const char *name;
+    uint32_t count;
+    const unsigned char *values;
+} status_text_binary_metric_t;
+
+/* check a snapshot of len bytes and fill b, return STATUS_TEXT_BINARY_OK
+ * or an error */
+int status_text_binary_open(status_text_binary_t *b, const void *buf, size_t len);
+
+/* get the metric i (0 to nb_metrics - 1) */
+int status_text_binary_metric(const status_text_binary_t *b, uint32_t i,
+                              status_text_binary_metric_t *m);
+
+/* get a metric by name, return STATUS_TEXT_BINARY_OK or -1 if not found */
+int status_text_binary_find(const status_text_binary_t *b, const char *name,
+                            status_text_binary_metric_t *m);
+
+/* values of a metric: the double of a STATUS_TEXT_BINARY_F64 metric, the
+ * u64 i of the other ones (for an histogram, the upper bound of the pair
+ * i/2 if i is even, its count if i is odd) */
+double status_text_binary_f64(const status_text_binary_metric_t *m);
+uint64_t status_text_binary_u64(const status_text_binary_metric_t *m, uint32_t i);
+
+/* message of a decoder error */
+const char *status_text_binary_strerror(int err);
+
+/* 32 bits FNV-1a hash of a metric name, its id */
+uint32_t status_text_binary_id(const char *name);
+
+#endif
@@ -0,0 +1,162 @@
+/* Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/* reference decoder of the mod_status_text binary format, see
+ * status_text_binary.h. it does not copy the snapshot: the decoded values
+ * point in the buffer. */
+
+#include <string.h>
+
+#include "status_text_binary.h"
+
+static uint32_t get_le32(const unsigned char *p)
+{
+    return (uint32_t)p[0] | (uint32_t)p[1] << 8 | (uint32_t)p[2] << 16 | (uint32_t)p[3] << 24;
+}
+
+static uint64_t get_le64(const unsigned char *p)
+{
+    return (uint64_t)get_le32(p) | (uint64_t)get_le32(p + 4) << 32;
+}
+
+int status_text_binary_open(status_text_binary_t *b, const void *buf, size_t len)
+{
+    const unsigned char *p = buf;
+    uint32_t header_size;
+    uint64_t end;
+
+    if (len < STATUS_TEXT_BINARY_HEADER_SIZE) return STATUS_TEXT_BINARY_ETRUNCATED;
+    if (memcmp(p, STATUS_TEXT_BINARY_MAGIC, 4) != 0) return STATUS_TEXT_BINARY_EMAGIC;
+
+    /* the next versions only add fields, and bytes after the data */
+    b->version = p[4] | p[5] << 8;
+    if (b->version < 1) return STATUS_TEXT_BINARY_EVERSION;
+    header_size = p[6] | p[7] << 8;
+    b->nb_metrics = get_le32(p + 8);
+    b->entry_size = get_le32(p + 12);
+    b->names_size = get_le32(p + 16);
+    b->data_size = get_le32(p + 20);
+    b->current_time = get_le64(p + 24);
+    b->restart_time = get_le64(p + 32);
+    b->generation = get_le32(p + 40);
+    if (header_size < STATUS_TEXT_BINARY_HEADER_SIZE || b->entry_size < STATUS_TEXT_BINARY_ENTRY_SIZE)
+      return STATUS_TEXT_BINARY_ECORRUPT;
+
+    end = (uint64_t)header_size + (uint64_t)b->nb_metrics * b->entry_size
+        + b->names_size + b->data_size;
+    if (end > len) return STATUS_TEXT_BINARY_ETRUNCATED;
+    b->table = p + header_size;
+    b->names = (const char *)b->table + (size_t)b->nb_metrics * b->entry_size;
+    b->data = (const unsigned char *)b->names + b->names_size;
+    return STATUS_TEXT_BINARY_OK;
+}
+
+int status_text_binary_metric(const status_text_binary_t *b, uint32_t i,
+                              status_text_binary_metric_t *m)
+{
+    const unsigned char *e;
+    uint32_t name, offset;
+    uint64_t size;
+
+    if (i >= b->nb_metrics) return STATUS_TEXT_BINARY_ECORRUPT;
+    e = b->table + (size_t)i * b->entry_size;
+    m->id = get_le32(e);
+    m->kind = e[4];
+    m->type = e[5];
+    name = get_le32(e + 8);
+    m->count = get_le32(e + 12);
+    offset = get_le32(e + 16);
+
+    /* the name must be NUL terminated in the names */
+    if (name >= b->names_size || memchr(b->names + name, '\0', b->names_size - name) == NULL)
+      return STATUS_TEXT_BINARY_ECORRUPT;
+    m->name = b->names + name;
+
+    switch (m->kind)
+    {
+      case STATUS_TEXT_BINARY_F64:
+        size = 8;
+        break;
+      case STATUS_TEXT_BINARY_STRING:
+        size = m->count;
+        break;
+      case STATUS_TEXT_BINARY_U64_ARRAY:
+        size = (uint64_t)m->count * 8;
+        break;
+      case STATUS_TEXT_BINARY_HISTOGRAM:
+        size = (uint64_t)m->count * 16;
+        break;
+      default:
+        size = 0; /* unknown kind, skipped by the caller */
+    }
+    if ((uint64_t)offset + size > b->data_size) return STATUS_TEXT_BINARY_ECORRUPT;
+    m->values = b->data + offset;
+    return STATUS_TEXT_BINARY_OK;
+}
+
+int status_text_binary_find(const status_text_binary_t *b, const char *name,
+                            status_text_binary_metric_t *m)
+{
+    uint32_t id = status_text_binary_id(name);
+    uint32_t i;
+
+    for (i = 0; i < b->nb_metrics; ++i)
+    {
+      if (get_le32(b->table + (size_t)i * b->entry_size) != id) continue;
+      if (status_text_binary_metric(b, i, m) == STATUS_TEXT_BINARY_OK && strcmp(m->name, name) == 0)
+        return STATUS_TEXT_BINARY_OK;
+    }
+    return -1;
+}
+
+double status_text_binary_f64(const status_text_binary_metric_t *m)
+{
+    uint64_t bits = get_le64(m->values);
+    double v;
+
+    memcpy(&v, &bits, sizeof(v));
+    return v;
+}
+
+uint64_t status_text_binary_u64(const status_text_binary_metric_t *m, uint32_t i)
+{
+    return get_le64(m->values + (size_t)i * 8);
+}
+
+const char *status_text_binary_strerror(int err)
+{
+    switch (err)
+    {
+      case STATUS_TEXT_BINARY_OK: return "no error";
+      case STATUS_TEXT_BINARY_ETRUNCATED: return "truncated snapshot";
+      case STATUS_TEXT_BINARY_EMAGIC: return "not a status text snapshot";
+      case STATUS_TEXT_BINARY_EVERSION: return "unsupported snapshot version";
+      case STATUS_TEXT_BINARY_ECORRUPT: return "corrupted snapshot";
+    }
+    return "unknown error";
+}
+
+uint32_t status_text_binary_id(const char *name)
+{
+    uint32_t h = 2166136261u;
+
+    while (*name)
+    {
+      h ^= (unsigned char)*name++;
+      h *= 16777619u;
+    }
+    return h;
+}
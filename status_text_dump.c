@@ -0,0 +1,136 @@
+/* Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/* print a mod_status_text binary snapshot as "key: value" lines
+ *
+ *   curl -s 'http://localhost/server-status-text?format=binary' | status_text_dump
+ *   status_text_dump snapshot.bin
+ */
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "status_text_binary.h"
+
+/* read a whole file, NULL on error */
+static unsigned char *read_all(FILE *f, size_t *len)
+{
+    unsigned char *buf = NULL, *tmp;
+    size_t size = 0, n;
+
+    *len = 0;
+    for (;;)
+    {
+      if (*len == size)
+      {
+        size = size ? size * 2 : 65536;
+        if ((tmp = realloc(buf, size)) == NULL)
+        {
+          free(buf);
+          return NULL;
+        }
+        buf = tmp;
+      }
+      n = fread(buf + *len, 1, size - *len, f);
+      if (n == 0) break;
+      *len += n;
+    }
+    if (ferror(f))
+    {
+      free(buf);
+      return NULL;
+    }
+    return buf;
+}
+
+static void print_metric(const status_text_binary_metric_t *m)
+{
+    uint32_t i;
+
+    printf("%s: ", m->name);
+    switch (m->kind)
+    {
+      case STATUS_TEXT_BINARY_F64:
+        printf("%.17g", status_text_binary_f64(m));
+        break;
+      case STATUS_TEXT_BINARY_STRING:
+        fwrite(m->values, 1, m->count, stdout);
+        break;
+      case STATUS_TEXT_BINARY_U64_ARRAY:
+        for (i = 0; i < m->count; ++i)
+          printf("%s%" PRIu64, i ? "," : "", status_text_binary_u64(m, i));
+        break;
+      case STATUS_TEXT_BINARY_HISTOGRAM:
+        for (i = 0; i < m->count; ++i)
+          printf("%s%" PRIu64 ":%" PRIu64, i ? "," : "",
+                 status_text_binary_u64(m, 2 * i), status_text_binary_u64(m, 2 * i + 1));
+        break;
+      default:
+        printf("(unknown kind %u)", m->kind);
+    }
+    putchar('\n');
+}
+
+int main(int argc, char **argv)
+{
+    status_text_binary_t b;
+    status_text_binary_metric_t m;
+    unsigned char *buf;
+    size_t len;
+    uint32_t i;
+    FILE *f = stdin;
+    int err;
+
+    if (argc > 2)
+    {
+      fprintf(stderr, "usage: %s [snapshot]\n", argv[0]);
+      return 2;
+    }
+    if (argc == 2 && (f = fopen(argv[1], "rb")) == NULL)
+    {
+      perror(argv[1]);
+      return 1;
+    }
+    buf = read_all(f, &len);
+    if (f != stdin) fclose(f);
+    if (buf == NULL)
+    {
+      fprintf(stderr, "%s: read error\n", argv[0]);
+      return 1;
+    }
+
+    if ((err = status_text_binary_open(&b, buf, len)) != STATUS_TEXT_BINARY_OK)
+    {
+      fprintf(stderr, "%s: %s\n", argv[0], status_text_binary_strerror(err));
+      free(buf);
+      return 1;
+    }
+    printf("Snapshot_Version: %u\nSnapshot_Time: %" PRIu64 "\nSnapshot_Restart_Time: %" PRIu64
+           "\nSnapshot_Generation: %" PRIu32 "\n", b.version, b.current_time, b.restart_time, b.generation);
+    for (i = 0; i < b.nb_metrics; ++i)
+    {
+      if ((err = status_text_binary_metric(&b, i, &m)) != STATUS_TEXT_BINARY_OK)
+      {
+        fprintf(stderr, "%s: metric %" PRIu32 ": %s\n", argv[0], i, status_text_binary_strerror(err));
+        free(buf);
+        return 1;
+      }
+      print_metric(&m);
+    }
+    free(buf);
+    return 0;
+}
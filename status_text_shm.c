@@ -0,0 +1,301 @@
+/* Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/* reader of the mod_status_text segment exported by StatusTextExportFile,
+ * see status_text_shm.h. it maps the file read only and copies the slots
+ * under their seqlock and the blocks between their folds, as the handler
+ * does: the workers are never blocked. */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "status_text_shm.h"
+
+/* maximum number of copies of a slot while its worker updates it, or of
+ * a block while its slots are folded */
+#define READ_TRIES 100
+
+/* largest slot and cold entry copied */
+#define MAX_SLOT_SIZE 65536
+#define MAX_COLD_SIZE 4096
+#define MAX_BLOCK_SIZE 65536
+
+#if defined(__ATOMIC_ACQUIRE)
+#define READ_BARRIER() __atomic_thread_fence(__ATOMIC_ACQUIRE)
+#else
+#define READ_BARRIER() __sync_synchronize()
+#endif
+
+static int check_area(const status_text_shm_t *m, uint64_t offset, uint64_t count, uint64_t size)
+{
+    return offset <= m->size && count * size <= m->size - offset;
+}
+
+int status_text_shm_open(status_text_shm_t *m, const char *path)
+{
+    const status_text_shm_header_t *h;
+    struct stat st;
+    void *base;
+    int fd, err;
+
+    memset(m, 0, sizeof(*m));
+    if ((fd = open(path, O_RDONLY)) < 0) return STATUS_TEXT_SHM_ESYSTEM;
+    if (fstat(fd, &st) < 0)
+    {
+      err = errno;
+      close(fd);
+      errno = err;
+      return STATUS_TEXT_SHM_ESYSTEM;
+    }
+    if ((size_t)st.st_size < sizeof(status_text_shm_header_t))
+    {
+      close(fd);
+      return STATUS_TEXT_SHM_EMAGIC;
+    }
+    base = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    err = errno;
+    close(fd);
+    if (base == MAP_FAILED)
+    {
+      errno = err;
+      return STATUS_TEXT_SHM_ESYSTEM;
+    }
+    m->base = base;
+    m->size = st.st_size;
+    m->header = h = base;
+
+    if (memcmp(h->magic, STATUS_TEXT_SHM_MAGIC, 4) != 0) err = STATUS_TEXT_SHM_EMAGIC;
+    else if (h->version != STATUS_TEXT_SHM_VERSION || h->byte_order != STATUS_TEXT_SHM_BYTE_ORDER ||
+             h->header_size < sizeof(status_text_shm_header_t))
+      err = STATUS_TEXT_SHM_EVERSION;
+    else if (h->size > m->size || h->nb_codes > STATUS_TEXT_SHM_MAX_CODES ||
+             h->nb_latency > STATUS_TEXT_SHM_MAX_LATENCY || h->nb_hist > STATUS_TEXT_SHM_MAX_HIST ||
+             h->slot_size > MAX_SLOT_SIZE || h->cold_size > MAX_COLD_SIZE ||
+             h->block_size > MAX_BLOCK_SIZE || (uint64_t)h->nb_blocks * h->threads > h->nb_slots ||
+             !check_area(m, h->slots_offset, h->nb_slots, h->slot_size) ||
+             !check_area(m, h->blocks_offset, h->nb_blocks + 1ULL, h->block_size) ||
+             !check_area(m, h->cold_offset, h->nb_slots, h->cold_size) ||
+             !check_area(m, h->series_offset, h->series_seconds, h->series_size) ||
+             h->codes_offset + 8ULL * h->nb_codes > h->slot_size ||
+             h->latency_offset + 4ULL * h->nb_latency > h->slot_size ||
+             h->hist_offset + 4ULL * h->nb_hist > h->slot_size ||
+             h->time_sum_offset + 8ULL > h->slot_size || h->seq_offset + 4ULL > h->slot_size ||
+             h->max_offset + 8ULL > h->cold_size ||
+             h->block_used_offset + 4ULL > h->block_size ||
+             h->block_fold_start_offset + 4ULL > h->block_size ||
+             h->block_fold_end_offset + 4ULL > h->block_size ||
+             h->block_codes_offset + 16ULL * h->nb_codes > h->block_size ||
+             h->block_latency_offset + 8ULL * h->nb_latency > h->block_size ||
+             h->block_hist_offset + 8ULL * h->nb_hist > h->block_size ||
+             h->block_time_sum_offset + 8ULL > h->block_size ||
+             h->block_max_offset + 8ULL > h->block_size)
+      err = STATUS_TEXT_SHM_ECORRUPT;
+    else
+      return STATUS_TEXT_SHM_OK;
+    status_text_shm_close(m);
+    return err;
+}
+
+void status_text_shm_close(status_text_shm_t *m)
+{
+    if (m->base) munmap((void *)m->base, m->size);
+    memset(m, 0, sizeof(*m));
+}
+
+static uint64_t get_u64(const unsigned char *p)
+{
+    uint64_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+static uint32_t get_u32(const unsigned char *p)
+{
+    uint32_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+/* consistent copy of the slot i and its cold entry, return the copies
+ * retried, READ_TRIES when the worker was still updating it */
+static int copy_slot(const status_text_shm_t *m, uint32_t i, unsigned char *slot, unsigned char *cold)
+{
+    const status_text_shm_header_t *h = m->header;
+    const unsigned char *src = m->base + h->slots_offset + (size_t)i * h->slot_size;
+    const unsigned char *src_cold = m->base + h->cold_offset + (size_t)i * h->cold_size;
+    uint32_t seq;
+    int tries;
+
+    for (tries = 0; tries < READ_TRIES; ++tries)
+    {
+      seq = *(const volatile uint32_t *)(src + h->seq_offset);
+      READ_BARRIER();
+      memcpy(slot, src, h->slot_size);
+      memcpy(cold, src_cold, h->cold_size);
+      READ_BARRIER();
+      if (!(seq & 1) && seq == *(const volatile uint32_t *)(src + h->seq_offset)) break;
+    }
+    return tries;
+}
+
+/* add the u64 totals of a block */
+static void add_block(const status_text_shm_header_t *h, status_text_shm_totals_t *t,
+                      const unsigned char *blk)
+{
+    int64_t max;
+    uint32_t k;
+
+    for (k = 0; k < h->nb_codes; ++k)
+    {
+      t->code_reqs[k] += get_u64(blk + h->block_codes_offset + 16 * k);
+      t->code_bytes[k] += get_u64(blk + h->block_codes_offset + 16 * k + 8);
+    }
+    for (k = 0; k < h->nb_latency; ++k)
+      t->latency[k] += get_u64(blk + h->block_latency_offset + 8 * k);
+    for (k = 0; k < h->nb_hist; ++k)
+      t->hist[k] += get_u64(blk + h->block_hist_offset + 8 * k);
+    t->time_sum += get_u64(blk + h->block_time_sum_offset);
+    memcpy(&max, blk + h->block_max_offset, sizeof(max));
+    if (max > t->max) t->max = max;
+}
+
+/* add the u32 counters of a slot copy */
+static void add_slot(const status_text_shm_header_t *h, status_text_shm_totals_t *t,
+                     const unsigned char *slot, const unsigned char *cold)
+{
+    int64_t max;
+    uint32_t k;
+
+    for (k = 0; k < h->nb_codes; ++k)
+    {
+      t->code_reqs[k] += get_u32(slot + h->codes_offset + 8 * k);
+      t->code_bytes[k] += get_u32(slot + h->codes_offset + 8 * k + 4);
+    }
+    for (k = 0; k < h->nb_latency; ++k)
+      t->latency[k] += get_u32(slot + h->latency_offset + 4 * k);
+    for (k = 0; k < h->nb_hist; ++k)
+      t->hist[k] += get_u32(slot + h->hist_offset + 4 * k);
+    t->time_sum += get_u64(slot + h->time_sum_offset);
+    memcpy(&max, cold + h->max_offset, sizeof(max));
+    if (max > t->max) t->max = max;
+}
+
+/* add the totals of a block copy */
+static void add_totals(status_text_shm_totals_t *t, const status_text_shm_totals_t *b)
+{
+    int k;
+
+    for (k = 0; k < STATUS_TEXT_SHM_MAX_CODES; ++k)
+    {
+      t->code_reqs[k] += b->code_reqs[k];
+      t->code_bytes[k] += b->code_bytes[k];
+    }
+    for (k = 0; k < STATUS_TEXT_SHM_MAX_LATENCY; ++k)
+      t->latency[k] += b->latency[k];
+    for (k = 0; k < STATUS_TEXT_SHM_MAX_HIST; ++k)
+      t->hist[k] += b->hist[k];
+    t->time_sum += b->time_sum;
+    if (b->max > t->max) t->max = b->max;
+    t->retries += b->retries;
+    t->skipped += b->skipped;
+}
+
+void status_text_shm_aggregate(const status_text_shm_t *m, status_text_shm_totals_t *t)
+{
+    const status_text_shm_header_t *h = m->header;
+    status_text_shm_totals_t acc;
+    unsigned char slot[MAX_SLOT_SIZE], cold[MAX_COLD_SIZE];
+    const unsigned char *blk;
+    uint32_t start, end, b, i, k, nb;
+    int tries, slot_tries;
+
+    memset(t, 0, sizeof(*t));
+    /* the used blocks with their slots, then the overflow block */
+    for (b = 0; b <= h->nb_blocks; ++b)
+    {
+      blk = m->base + h->blocks_offset + (size_t)b * h->block_size;
+      nb = b < h->nb_blocks ? h->threads : 0;
+      if (nb && !*(const volatile uint32_t *)(blk + h->block_used_offset)) continue;
+
+      /* no fold during the copy, else a folded value would be counted
+       * twice or not at all */
+      for (tries = 0; tries < READ_TRIES; ++tries)
+      {
+        memset(&acc, 0, sizeof(acc));
+        end = *(const volatile uint32_t *)(blk + h->block_fold_end_offset);
+        READ_BARRIER();
+        start = *(const volatile uint32_t *)(blk + h->block_fold_start_offset);
+        READ_BARRIER();
+        if (start != end) continue;
+
+        add_block(h, &acc, blk);
+        for (i = 0; i < nb; ++i)
+        {
+          slot_tries = copy_slot(m, b * h->threads + i, slot, cold);
+          acc.retries += slot_tries;
+          if (slot_tries == READ_TRIES) acc.skipped++;
+          else add_slot(h, &acc, slot, cold);
+        }
+        READ_BARRIER();
+        if (*(const volatile uint32_t *)(blk + h->block_fold_start_offset) == start) break;
+      }
+      t->retries += tries;
+      if (tries == READ_TRIES)
+      {
+        t->skipped++;
+        continue;
+      }
+      add_totals(t, &acc);
+    }
+    for (k = 0; k < h->nb_codes; ++k)
+    {
+      t->reqs += t->code_reqs[k];
+      t->bytes += t->code_bytes[k];
+    }
+}
+
+int status_text_shm_superseded(const status_text_shm_t *m)
+{
+    return m->header->superseded != 0;
+}
+
+int64_t status_text_shm_hist_upper(const status_text_shm_t *m, int idx)
+{
+    uint32_t sub_bits = m->header->hist_sub_bits;
+    uint64_t sub_count = (uint64_t)1 << sub_bits;
+    int shift;
+
+    if ((uint64_t)idx < 2 * sub_count) return idx;
+    shift = (idx >> sub_bits) - 1;
+    return (int64_t)(((((uint64_t)idx & (sub_count - 1)) + sub_count + 1) << shift) - 1);
+}
+
+const char *status_text_shm_strerror(int err)
+{
+    switch (err)
+    {
+      case STATUS_TEXT_SHM_OK: return "no error";
+      case STATUS_TEXT_SHM_ESYSTEM: return strerror(errno);
+      case STATUS_TEXT_SHM_EMAGIC: return "not a status text segment";
+      case STATUS_TEXT_SHM_EVERSION: return "unsupported segment version or byte order";
+      case STATUS_TEXT_SHM_ECORRUPT: return "corrupted segment header";
+    }
+    return "unknown error";
+}
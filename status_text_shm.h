@@ -0,0 +1,171 @@
+/* Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/* self describing header of the mod_status_text shared memory segment,
+ * and the library (status_text_shm.c) reading the segment exported by
+ * StatusTextExportFile.
+ *
+ * the segment starts with this header, in the byte order and alignment of
+ * the server (it is only read on the same host), then:
+ *
+ *   slots   nb_slots slots of slot_size bytes, one per worker thread (per
+ *           process without threads or with StatusTextGranularity
+ *           process), from slots_offset
+ *   blocks  nb_blocks + 1 blocks of block_size bytes, from blocks_offset
+ *   cold    nb_slots entries of cold_size bytes, from cold_offset
+ *   series  series_seconds seconds of series_size bytes, from series_offset
+ *
+ * the slots are grouped by blocks of threads slots, one block per child
+ * process: the slots of the block b are b * threads to (b + 1) * threads - 1.
+ * the last block (nb_blocks) is the overflow one, without slot. a block not
+ * used has no statistics.
+ *
+ * a slot is written by its worker only (by the threads of its process in
+ * turn with StatusTextGranularity process), under a seqlock: the u32 at
+ * seq_offset is odd while the worker updates the slot and its cold entry,
+ * a reader copies the slot again when it was odd or changed during the
+ * copy. the counters of a slot are u32, added to the u64 totals of its
+ * block before they overflow, between the increments of the u32 at
+ * block_fold_start_offset and of the u32 at block_fold_end_offset: a
+ * reader reads fold_end then fold_start, adds up the block totals and its
+ * slots only when they are equal, and again when fold_start changed
+ * meanwhile. the totals of a block are its u64 counters plus the u32
+ * counters of its slots.
+ *
+ * the other fields are given by their offsets: a reader must only use the
+ * fields it knows, the next versions only add fields.
+ */
+
+#ifndef STATUS_TEXT_SHM_H
+#define STATUS_TEXT_SHM_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define STATUS_TEXT_SHM_MAGIC       "STXS"
+#define STATUS_TEXT_SHM_VERSION     2
+#define STATUS_TEXT_SHM_HEADER_SIZE 1024       /* room reserved for the header */
+#define STATUS_TEXT_SHM_BYTE_ORDER  0x01020304 /* byte_order in the server byte order */
+#define STATUS_TEXT_SHM_MAX_LATENCY 32
+#define STATUS_TEXT_SHM_MAX_CODES   128
+#define STATUS_TEXT_SHM_MAX_HIST    256
+
+typedef struct {
+    char magic[4];           /* STATUS_TEXT_SHM_MAGIC */
+    uint16_t version;        /* STATUS_TEXT_SHM_VERSION */
+    uint16_t header_size;    /* sizeof(status_text_shm_header_t) */
+    uint32_t byte_order;     /* STATUS_TEXT_SHM_BYTE_ORDER */
+    uint32_t cache_line;     /* alignment of the slots */
+    uint64_t size;           /* size of the segment */
+    int64_t create_time;     /* creation time (microseconds since the epoch) */
+    uint32_t pid;            /* pid of the parent process */
+    volatile uint32_t generation; /* incremented at each restart */
+
+    /* areas */
+    uint64_t slots_offset;
+    uint32_t nb_slots;
+    uint32_t slot_size;
+    uint64_t blocks_offset;
+    uint32_t nb_blocks;      /* without the overflow block */
+    uint32_t block_size;
+    uint32_t threads;        /* slots per block */
+    uint32_t reserved_area;
+    uint64_t cold_offset;
+    uint32_t cold_size;
+    uint32_t series_seconds;
+    uint64_t series_offset;
+    uint32_t series_size;
+
+    /* fields of a slot: offsets in the slot */
+    uint32_t seq_offset;      /* u32 seqlock sequence */
+    uint32_t codes_offset;    /* nb_codes pairs of u32: requests, bytes */
+    uint32_t nb_codes;
+    uint32_t latency_offset;  /* u32 requests per response time range */
+    uint32_t nb_latency;      /* response time ranges in use */
+    uint32_t hist_offset;     /* u32 requests per histogram bucket */
+    uint32_t nb_hist;
+    uint32_t hist_sub_bits;   /* log-linear geometry, see status_text_shm_hist_upper */
+    uint32_t time_sum_offset; /* u64 sum of the response times (microseconds) */
+    uint32_t max_offset;      /* i64 maximum response time, in the cold entry */
+    uint32_t reserved;
+
+    /* fields of a block: offsets in the block */
+    uint32_t block_used_offset;       /* u32, 0 if the block is not used */
+    uint32_t block_fold_start_offset; /* u32 folds started */
+    uint32_t block_fold_end_offset;   /* u32 folds done */
+    uint32_t block_codes_offset;      /* nb_codes pairs of u64: requests, bytes */
+    uint32_t block_latency_offset;    /* u64 requests per response time range */
+    uint32_t block_hist_offset;       /* u64 requests per histogram bucket */
+    uint32_t block_time_sum_offset;   /* u64 sum of the response times, not in the slots */
+    uint32_t block_max_offset;        /* i64 maximum response time, not in the cold entries */
+
+    /* upper bounds of the response time ranges (microseconds), the last
+     * range is unbounded */
+    int64_t latency_bounds[STATUS_TEXT_SHM_MAX_LATENCY];
+    /* status code of each code counter, or its class (1 to 5) for the
+     * other codes of the class, 0 for the invalid codes */
+    uint16_t codes[STATUS_TEXT_SHM_MAX_CODES];
+
+    /* set when the server replaced the segment by a new one of the same
+     * file (or stopped): the readers must map the file again */
+    volatile uint32_t superseded;
+} status_text_shm_header_t;
+
+/* errors of status_text_shm_open */
+#define STATUS_TEXT_SHM_OK        0
+#define STATUS_TEXT_SHM_ESYSTEM   1 /* open, fstat or mmap failed, see errno */
+#define STATUS_TEXT_SHM_EMAGIC    2 /* not a segment */
+#define STATUS_TEXT_SHM_EVERSION  3 /* unsupported version or byte order */
+#define STATUS_TEXT_SHM_ECORRUPT  4 /* areas outside of the segment */
+
+/* a mapped segment */
+typedef struct {
+    const unsigned char *base;
+    size_t size;
+    const status_text_shm_header_t *header;
+} status_text_shm_t;
+
+/* totals of the blocks and their slots */
+typedef struct {
+    uint64_t reqs;
+    uint64_t bytes;
+    uint64_t time_sum;  /* microseconds */
+    int64_t max;        /* maximum response time (microseconds) */
+    uint64_t code_reqs[STATUS_TEXT_SHM_MAX_CODES];
+    uint64_t code_bytes[STATUS_TEXT_SHM_MAX_CODES];
+    uint64_t latency[STATUS_TEXT_SHM_MAX_LATENCY];
+    uint64_t hist[STATUS_TEXT_SHM_MAX_HIST];
+    uint32_t retries;   /* slot and block copies retried */
+    uint32_t skipped;   /* slots or blocks still updated after the retries */
+} status_text_shm_totals_t;
+
+/* map a segment read only */
+int status_text_shm_open(status_text_shm_t *m, const char *path);
+void status_text_shm_close(status_text_shm_t *m);
+
+/* non zero once the server dropped the segment: close it and open the
+ * file again */
+int status_text_shm_superseded(const status_text_shm_t *m);
+
+/* add up the blocks and their slots, without locking the workers */
+void status_text_shm_aggregate(const status_text_shm_t *m, status_text_shm_totals_t *t);
+
+/* highest response time counted in an histogram bucket */
+int64_t status_text_shm_hist_upper(const status_text_shm_t *m, int idx);
+
+const char *status_text_shm_strerror(int err);
+
+#endif
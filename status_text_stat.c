@@ -0,0 +1,160 @@
+/* Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/* print the totals of a mod_status_text segment exported by
+ * StatusTextExportFile, without going through http
+ *
+ *   status_text_stat logs/status_text.shm
+ *   status_text_stat -i 100 -n 50 logs/status_text.shm
+ *
+ * with -i, a sample is printed every interval (in ms), with the rates
+ * since the previous sample.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "status_text_shm.h"
+
+/* key suffix of a response time range, as the module: "500us", "50ms",
+ * "1s", "1_5s" */
+static void print_latency_name(int64_t bound)
+{
+    if (bound % 1000000 == 0)
+      printf("%" PRId64 "s", bound / 1000000);
+    else if (bound > 1000000 && bound % 100000 == 0)
+      printf("%" PRId64 "_%" PRId64 "s", bound / 1000000, (bound % 1000000) / 100000);
+    else if (bound % 1000 == 0)
+      printf("%" PRId64 "ms", bound / 1000);
+    else
+      printf("%" PRId64 "us", bound);
+}
+
+static void print_totals(const status_text_shm_t *m, const status_text_shm_totals_t *t,
+                         const status_text_shm_totals_t *prev, double elapsed)
+{
+    const status_text_shm_header_t *h = m->header;
+    uint32_t k;
+    int n;
+
+    printf("Apache_Total_Reqs: %" PRIu64 "\n", t->reqs);
+    printf("Apache_Total_Bytes: %" PRIu64 "\n", t->bytes);
+    if (prev && elapsed > 0)
+    {
+      printf("Apache_Reqs_Per_Sec: %.3f\n", (double)(t->reqs - prev->reqs) / elapsed);
+      printf("Apache_Bytes_Per_Sec: %.3f\n", (double)(t->bytes - prev->bytes) / elapsed);
+    }
+    printf("Apache_Avg_ResponseTime: %.3f\n", t->reqs ? (double)t->time_sum / t->reqs / 1000.0 : 0.0);
+    printf("Apache_Max_ResponseTime: %.3f\n", t->max / 1000.0);
+
+    for (k = 0; k < h->nb_codes; ++k)
+    {
+      if (t->code_reqs[k] == 0 || h->codes[k] == 0) continue;
+      if (h->codes[k] < 6)
+        printf("Apache_NB_Reqs_%uxx_Other: %" PRIu64 "\nApache_NB_Bytes_%uxx_Other: %" PRIu64 "\n",
+               h->codes[k], t->code_reqs[k], h->codes[k], t->code_bytes[k]);
+      else
+        printf("Apache_NB_Reqs_%u: %" PRIu64 "\nApache_NB_Bytes_%u: %" PRIu64 "\n",
+               h->codes[k], t->code_reqs[k], h->codes[k], t->code_bytes[k]);
+    }
+
+    for (k = 0; k < h->nb_latency; ++k)
+    {
+      printf("Apache_NB_Reqs_");
+      if (k < h->nb_latency - 1) print_latency_name(h->latency_bounds[k]);
+      else printf("xs");
+      printf(": %" PRIu64 "\n", t->latency[k]);
+    }
+
+    printf("Apache_ResponseTime_Histogram: ");
+    for (k = 0, n = 0; k < h->nb_hist; ++k)
+      if (t->hist[k])
+        printf("%s%" PRId64 ":%" PRIu64, n++ ? "," : "", status_text_shm_hist_upper(m, k), t->hist[k]);
+    printf("\nApache_Snapshot_Retries: %" PRIu32 "\n", t->retries);
+    if (t->skipped) printf("Apache_Snapshot_Skipped: %" PRIu32 "\n", t->skipped);
+}
+
+static double now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+int main(int argc, char **argv)
+{
+    status_text_shm_t m;
+    status_text_shm_totals_t totals[2];
+    long interval = 0, count = -1, i;
+    double last = 0, t;
+    int c, err;
+
+    while ((c = getopt(argc, argv, "i:n:")) != -1)
+    {
+      switch (c)
+      {
+        case 'i': interval = atol(optarg); break;
+        case 'n': count = atol(optarg); break;
+        default:
+          fprintf(stderr, "usage: %s [-i interval_ms] [-n count] segment\n", argv[0]);
+          return 2;
+      }
+    }
+    if (optind != argc - 1 || interval < 0)
+    {
+      fprintf(stderr, "usage: %s [-i interval_ms] [-n count] segment\n", argv[0]);
+      return 2;
+    }
+    if ((err = status_text_shm_open(&m, argv[optind])) != STATUS_TEXT_SHM_OK)
+    {
+      fprintf(stderr, "%s: %s: %s\n", argv[0], argv[optind], status_text_shm_strerror(err));
+      return 1;
+    }
+
+    for (i = 0; interval ? count < 0 || i < count : i < 1; ++i)
+    {
+      struct timespec ts;
+
+      /* the server restarted with a new segment */
+      if (status_text_shm_superseded(&m))
+      {
+        status_text_shm_close(&m);
+        if ((err = status_text_shm_open(&m, argv[optind])) != STATUS_TEXT_SHM_OK)
+        {
+          fprintf(stderr, "%s: %s: %s\n", argv[0], argv[optind], status_text_shm_strerror(err));
+          return 1;
+        }
+      }
+      t = now();
+      status_text_shm_aggregate(&m, &totals[i & 1]);
+      if (i) putchar('\n');
+      print_totals(&m, &totals[i & 1], i ? &totals[(i - 1) & 1] : NULL, t - last);
+      fflush(stdout);
+      last = t;
+      if (!interval) break;
+      ts.tv_sec = interval / 1000;
+      ts.tv_nsec = (interval % 1000) * 1000000;
+      nanosleep(&ts, NULL);
+    }
+    status_text_shm_close(&m);
+    return 0;
+}